@@ -0,0 +1,569 @@
+/*
+Cubesat Space Protocol - A small network-layer protocol designed for Cubesats
+Copyright (C) 2012 GomSpace ApS (http://www.gomspace.com)
+Copyright (C) 2012 AAUSAT3 Project (http://aausat3.space.aau.dk)
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+/*
+ * Multi-task stress test of the lock-free and concurrent primitives used by CSP:
+ * - queue (lock-free ring on POSIX), single and bulk operations
+ * - multi-priority queue with weighted scheduling
+ * - connection free list and ephemeral port allocation
+ * - timer wheel (arm, re-arm, cancel and cascade)
+ * - router input from interface RX queues (polling and wake ups)
+ *
+ * Each test checks that no element is lost or duplicated, and that elements from a producer are seen in order.
+ * Uses internal headers, as the priority queue and timer wheel are not part of the public API.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <csp/csp.h>
+#include <csp/csp_iflist.h>
+#include <csp/arch/csp_queue.h>
+#include <csp/arch/csp_semaphore.h>
+#include <csp/arch/csp_thread.h>
+#include <csp/arch/csp_time.h>
+
+#include "csp_pqueue.h"
+#include "csp_qfifo.h"
+#include "csp_timer.h"
+
+#define USAGE \
+	"Usage: %s [-n N] [-h]\n" \
+	"Stress test of CSP queues, connection allocation, timers and router input\n" \
+	"\nOptions:\n" \
+	"  -n : Number of elements per producer (default 100000)\n" \
+	"\n"
+
+#define TASKS		4		/* Producers and consumers per test */
+#define LEVELS		4		/* Priority queue levels */
+#define SEQ_BITS	20		/* Item: producer (8 bits), level (4 bits), sequence number */
+#define CONN_TASKS	8
+#define CONN_HOLD	4		/* Connections held at a time by a task */
+#define CONN_MAX	64
+#define TIMERS		2000
+#define TIMER_LATE_MAX	50		/* Max allowed timer latency (ms) */
+#define QFIFO_STALL_MS	1000	/* Max time the router may wait with packets queued (ms) */
+
+static unsigned int count = 100000;
+static unsigned int errors;
+static unsigned int done;
+
+/* Bitmap of seen sequence numbers, per producer */
+static uint32_t * seen[TASKS];
+static unsigned int consumed;
+
+/* Queue under test, see queue_producer() and queue_consumer() */
+static csp_queue_handle_t queue;
+static csp_pqueue_t * pqueue;
+
+#define CHECK(cond, ...) do { if (!(cond)) { printf(__VA_ARGS__); printf("\n"); __atomic_add_fetch(&errors, 1, __ATOMIC_RELAXED); } } while (0)
+
+static void wait_done(unsigned int tasks) {
+
+	while (__atomic_load_n(&done, __ATOMIC_ACQUIRE) < tasks) {
+		csp_sleep_ms(10);
+	}
+	done = 0;
+}
+
+static uint32_t item_make(unsigned int producer, unsigned int level, unsigned int seq) {
+
+	return (producer << 24) | (level << SEQ_BITS) | seq;
+}
+
+static void seen_reset(void) {
+
+	for (unsigned int i = 0; i < TASKS; i++) {
+		memset(seen[i], 0, ((count + 31) / 32) * sizeof(uint32_t));
+	}
+	consumed = 0;
+}
+
+/* Mark item seen, and check order per producer and level (as seen by one consumer) */
+static void item_check(uint32_t item, uint32_t last[TASKS][LEVELS]) {
+
+	const unsigned int producer = item >> 24;
+	const unsigned int level = (item >> SEQ_BITS) & 0xF;
+	const unsigned int seq = item & ((1 << SEQ_BITS) - 1);
+
+	if ((producer >= TASKS) || (level >= LEVELS) || (seq >= count)) {
+		CHECK(0, "corrupt item 0x%08x", (unsigned int) item);
+		return;
+	}
+
+	const uint32_t bit = 1UL << (seq % 32);
+	CHECK((__atomic_fetch_or(&seen[producer][seq / 32], bit, __ATOMIC_RELAXED) & bit) == 0,
+		  "duplicate item: producer %u, seq %u", producer, seq);
+	CHECK((last[producer][level] == UINT32_MAX) || (seq > last[producer][level]),
+		  "out of order: producer %u, level %u, seq %u after %u", producer, level, seq, (unsigned int) last[producer][level]);
+	last[producer][level] = seq;
+
+	__atomic_add_fetch(&consumed, 1, __ATOMIC_RELAXED);
+}
+
+static void seen_check(const char * name, unsigned int items) {
+
+	unsigned int missing = 0;
+	for (unsigned int i = 0; i < TASKS; i++) {
+		for (unsigned int seq = 0; seq < items; seq++) {
+			missing += ((seen[i][seq / 32] & (1UL << (seq % 32))) == 0);
+		}
+	}
+	CHECK(missing == 0, "%s: %u items lost", name, missing);
+}
+
+static CSP_DEFINE_TASK(queue_producer) {
+
+	const unsigned int producer = (uintptr_t) param;
+	uint32_t items[8];
+	unsigned int seq = 0;
+
+	while (seq < count) {
+		if (producer & 1) {
+			/* Bulk enqueue, of as many as there is room for */
+			unsigned int n = 0;
+			for (; (n < 8) && ((seq + n) < count); n++) {
+				items[n] = item_make(producer, 0, seq + n);
+			}
+			seq += csp_queue_enqueue_bulk(queue, items, n, 1000);
+		} else {
+			items[0] = item_make(producer, 0, seq);
+			if (csp_queue_enqueue(queue, items, 1000) == CSP_QUEUE_OK) {
+				seq++;
+			}
+		}
+	}
+
+	__atomic_add_fetch(&done, 1, __ATOMIC_RELEASE);
+	return CSP_TASK_RETURN;
+}
+
+static CSP_DEFINE_TASK(queue_consumer) {
+
+	const unsigned int consumer = (uintptr_t) param;
+	uint32_t last[TASKS][LEVELS];
+	uint32_t items[8];
+
+	memset(last, 0xFF, sizeof(last));
+
+	while (__atomic_load_n(&consumed, __ATOMIC_RELAXED) < (TASKS * count)) {
+		int n;
+		if (consumer & 1) {
+			n = csp_queue_dequeue_bulk(queue, items, 8, 10);
+		} else {
+			n = (csp_queue_dequeue(queue, items, 10) == CSP_QUEUE_OK) ? 1 : 0;
+		}
+		for (int i = 0; i < n; i++) {
+			item_check(items[i], last);
+		}
+	}
+
+	__atomic_add_fetch(&done, 1, __ATOMIC_RELEASE);
+	return CSP_TASK_RETURN;
+}
+
+static void test_queue(void) {
+
+	queue = csp_queue_create(64, sizeof(uint32_t));
+	if (queue == NULL) {
+		CHECK(0, "queue: csp_queue_create() failed");
+		return;
+	}
+
+	seen_reset();
+	for (uintptr_t i = 0; i < TASKS; i++) {
+		csp_thread_create(queue_producer, "PROD", 0, (void *) i, 0, NULL);
+		csp_thread_create(queue_consumer, "CONS", 0, (void *) i, 0, NULL);
+	}
+	wait_done(2 * TASKS);
+
+	seen_check("queue", count);
+	CHECK(csp_queue_size(queue) == 0, "queue: %d items left", csp_queue_size(queue));
+	csp_queue_remove(queue);
+}
+
+static CSP_DEFINE_TASK(pqueue_producer) {
+
+	const unsigned int producer = (uintptr_t) param;
+	unsigned int seq = 0;
+
+	while (seq < count) {
+		const unsigned int level = (seq * 7 + producer) % LEVELS;
+		const uint32_t item = item_make(producer, level, seq);
+		if (csp_pqueue_enqueue(pqueue, level, &item) == CSP_QUEUE_OK) {
+			seq++;
+		} else {
+			csp_sleep_ms(1);
+		}
+	}
+
+	__atomic_add_fetch(&done, 1, __ATOMIC_RELEASE);
+	return CSP_TASK_RETURN;
+}
+
+static CSP_DEFINE_TASK(pqueue_consumer) {
+
+	const unsigned int consumer = (uintptr_t) param;
+	uint32_t last[TASKS][LEVELS];
+	uint32_t items[8];
+
+	memset(last, 0xFF, sizeof(last));
+
+	while (__atomic_load_n(&consumed, __ATOMIC_RELAXED) < (TASKS * count)) {
+		int n;
+		if (consumer & 1) {
+			n = csp_pqueue_dequeue_bulk(pqueue, items, 8, 10);
+		} else {
+			n = (csp_pqueue_dequeue(pqueue, items, 10) == CSP_QUEUE_OK) ? 1 : 0;
+		}
+		for (int i = 0; i < n; i++) {
+			item_check(items[i], last);
+		}
+	}
+
+	__atomic_add_fetch(&done, 1, __ATOMIC_RELEASE);
+	return CSP_TASK_RETURN;
+}
+
+static void test_pqueue(void) {
+
+	static const uint8_t weights[LEVELS] = {4, 2, 1, 1};
+
+	pqueue = csp_pqueue_create(LEVELS, 32, sizeof(uint32_t));
+	if (pqueue == NULL) {
+		CHECK(0, "pqueue: csp_pqueue_create() failed");
+		return;
+	}
+	csp_pqueue_set_weights(pqueue, weights);
+
+	seen_reset();
+	for (uintptr_t i = 0; i < TASKS; i++) {
+		csp_thread_create(pqueue_producer, "PROD", 0, (void *) i, 0, NULL);
+		csp_thread_create(pqueue_consumer, "CONS", 0, (void *) i, 0, NULL);
+	}
+	wait_done(2 * TASKS);
+
+	seen_check("pqueue", count);
+	CHECK(csp_pqueue_count(pqueue) == 0, "pqueue: %d items left", csp_pqueue_count(pqueue));
+	csp_pqueue_remove(pqueue);
+}
+
+/* Connections held by all tasks, a connection (or source port to a destination) must never be handed out twice */
+static csp_conn_t * held[CONN_TASKS * CONN_HOLD];
+static csp_mutex_t held_lock;
+
+static void conn_hold(unsigned int slot, csp_conn_t * conn) {
+
+	csp_mutex_lock(&held_lock, CSP_MAX_TIMEOUT);
+	for (unsigned int i = 0; i < (CONN_TASKS * CONN_HOLD); i++) {
+		if (held[i] == NULL) {
+			continue;
+		}
+		CHECK(held[i] != conn, "conn: %p allocated twice", (void *) conn);
+		CHECK((csp_conn_src(held[i]) != csp_conn_src(conn)) || (csp_conn_sport(held[i]) != csp_conn_sport(conn)) ||
+			  (csp_conn_dport(held[i]) != csp_conn_dport(conn)),
+			  "conn: port %u to %u:%u allocated twice", csp_conn_dport(conn), csp_conn_src(conn), csp_conn_sport(conn));
+	}
+	held[slot] = conn;
+	csp_mutex_unlock(&held_lock);
+}
+
+static CSP_DEFINE_TASK(conn_task) {
+
+	const unsigned int task = (uintptr_t) param;
+	csp_conn_t ** mine = &held[task * CONN_HOLD];
+
+	for (unsigned int i = 0; i < (count / 10); i++) {
+		const unsigned int slot = (i * 3 + task) % CONN_HOLD;
+		if (mine[slot]) {
+			csp_conn_t * conn = mine[slot];
+			csp_mutex_lock(&held_lock, CSP_MAX_TIMEOUT);
+			mine[slot] = NULL;
+			csp_mutex_unlock(&held_lock);
+			csp_close(conn);
+		}
+
+		csp_conn_t * conn = csp_connect(CSP_PRIO_NORM, 2 + (task % 3), 10, 0, CSP_O_NONE);
+		if (conn == NULL) {
+			CHECK(0, "conn: csp_connect() failed");
+			continue;
+		}
+		conn_hold(task * CONN_HOLD + slot, conn);
+	}
+
+	for (unsigned int slot = 0; slot < CONN_HOLD; slot++) {
+		csp_close(mine[slot]);
+		mine[slot] = NULL;
+	}
+
+	__atomic_add_fetch(&done, 1, __ATOMIC_RELEASE);
+	return CSP_TASK_RETURN;
+}
+
+static void test_conn(void) {
+
+	csp_mutex_create(&held_lock);
+
+	for (uintptr_t i = 0; i < CONN_TASKS; i++) {
+		csp_thread_create(conn_task, "CONN", 0, (void *) i, 0, NULL);
+	}
+	wait_done(CONN_TASKS);
+
+	/* All connections must be free again */
+	static csp_conn_t * conns[CONN_MAX + 1];
+	unsigned int n = 0;
+	for (; n <= CONN_MAX; n++) {
+		conns[n] = csp_connect(CSP_PRIO_NORM, 2 + (n % 8), 10, 0, CSP_O_NONE);
+		if (conns[n] == NULL) {
+			break;
+		}
+	}
+	CHECK(n == CONN_MAX, "conn: %u of %u connections free", n, CONN_MAX);
+	for (unsigned int i = 0; i < n; i++) {
+		csp_close(conns[i]);
+	}
+
+	csp_mutex_remove(&held_lock);
+}
+
+typedef struct {
+	csp_timer_t timer;
+	uint32_t expires;
+	bool cancelled;
+	unsigned int fired;
+	uint32_t late;
+} timer_test_t;
+
+static timer_test_t timers[TIMERS];
+static unsigned int timers_fired;
+
+static void timer_expired(csp_timer_t * timer) {
+
+	timer_test_t * t = timer->arg;
+	t->fired++;
+	t->late = csp_get_ms() - t->expires;
+	__atomic_add_fetch(&timers_fired, 1, __ATOMIC_RELEASE);
+}
+
+static CSP_DEFINE_TASK(timer_task) {
+
+	const unsigned int task = (uintptr_t) param;
+
+	for (unsigned int i = task; i < TIMERS; i += TASKS) {
+		timer_test_t * t = &timers[i];
+		csp_timer_setup(&t->timer, timer_expired, t);
+
+		/* Up to 2 s, to cascade timers from the higher levels */
+		t->expires = csp_get_ms() + 50 + ((i * 7919) % 2000);
+		csp_timer_arm(0, &t->timer, t->expires);
+		if ((i % 3) == 0) {
+			t->expires += (i % 500);
+			csp_timer_arm(0, &t->timer, t->expires);
+		}
+		if ((i % 5) == 0) {
+			const uint32_t earlier = t->expires - 20;
+			csp_timer_arm_earlier(0, &t->timer, earlier);
+			t->expires = earlier;
+		}
+		if ((i % 11) == 0) {
+			csp_timer_cancel(&t->timer);
+			t->cancelled = true;
+		}
+		if ((i % 16) == 0) {
+			csp_sleep_ms(1);
+		}
+	}
+
+	__atomic_add_fetch(&done, 1, __ATOMIC_RELEASE);
+	return CSP_TASK_RETURN;
+}
+
+static void test_timer(void) {
+
+	unsigned int expected = 0;
+	for (unsigned int i = 0; i < TIMERS; i++) {
+		expected += ((i % 11) != 0);
+	}
+
+	for (uintptr_t i = 0; i < TASKS; i++) {
+		csp_thread_create(timer_task, "TIMER", 0, (void *) i, 0, NULL);
+	}
+
+	/* No router task is started, so run the timers of shard 0 here */
+	const uint32_t start = csp_get_ms();
+	while ((__atomic_load_n(&done, __ATOMIC_ACQUIRE) < TASKS) ||
+		   ((__atomic_load_n(&timers_fired, __ATOMIC_ACQUIRE) < expected) && ((csp_get_ms() - start) < 5000))) {
+		csp_timer_run(0);
+		csp_sleep_ms(1);
+	}
+	done = 0;
+
+	/* Cancelled timers must not fire later */
+	csp_sleep_ms(100);
+	csp_timer_run(0);
+
+	uint32_t late_max = 0;
+	for (unsigned int i = 0; i < TIMERS; i++) {
+		const timer_test_t * t = &timers[i];
+		CHECK(t->fired == (t->cancelled ? 0 : 1), "timer %u: fired %u times (cancelled %d)", i, t->fired, t->cancelled);
+		if (t->fired) {
+			CHECK((int32_t) t->late >= 0, "timer %u: fired %d ms early", i, -(int32_t) t->late);
+			if (((int32_t) t->late >= 0) && (t->late > late_max)) {
+				late_max = t->late;
+			}
+		}
+	}
+	CHECK(late_max <= TIMER_LATE_MAX, "timer: fired %u ms late", (unsigned int) late_max);
+}
+
+static csp_iface_t qfifo_ifaces[TASKS];
+static unsigned int qfifo_consumed[TASKS];
+
+/* Writes bursts of exactly the poll budget, each when the previous one is consumed, so the router drains the
+   RX queue at the budget and goes back to wake ups while the next burst arrives */
+static CSP_DEFINE_TASK(qfifo_producer) {
+
+	const unsigned int producer = (uintptr_t) param;
+	unsigned int seq = 0;
+
+	while (seq < (count / 10)) {
+		for (unsigned int i = 0; (i < CSP_QFIFO_POLL_BUDGET) && (seq < (count / 10)); i++, seq++) {
+			csp_packet_t * packet = csp_buffer_get(sizeof(uint32_t));
+			if (packet == NULL) {
+				CHECK(0, "qfifo: no buffer");
+				break;
+			}
+			const uint32_t item = item_make(producer, 0, seq);
+			memcpy(packet->data, &item, sizeof(item));
+			packet->length = sizeof(item);
+			packet->id.src = 2 + producer;
+			packet->id.dst = 1;
+			csp_qfifo_write(packet, &qfifo_ifaces[producer], NULL);
+		}
+		while (__atomic_load_n(&qfifo_consumed[producer], __ATOMIC_ACQUIRE) < seq) {
+			csp_sleep_ms(0);
+		}
+	}
+
+	__atomic_add_fetch(&done, 1, __ATOMIC_RELEASE);
+	return CSP_TASK_RETURN;
+}
+
+static void test_qfifo(void) {
+
+	static char names[TASKS][CSP_IFLIST_NAME_MAX + 1];
+
+	for (unsigned int i = 0; i < TASKS; i++) {
+		snprintf(names[i], sizeof(names[i]), "STRESS%u", i);
+		qfifo_ifaces[i].name = names[i];
+		csp_iflist_add(&qfifo_ifaces[i]);
+		CHECK(csp_iface_set_rx_queue(&qfifo_ifaces[i], CSP_QFIFO_POLL_BUDGET) == CSP_ERR_NONE, "qfifo: csp_iface_set_rx_queue() failed");
+	}
+
+	seen_reset();
+	for (uintptr_t i = 0; i < TASKS; i++) {
+		csp_thread_create(qfifo_producer, "QFIFO", 0, (void *) i, 0, NULL);
+	}
+
+	/* No router task is started, so read the router input of shard 0 here, like the router does */
+	uint32_t last[TASKS][LEVELS];
+	memset(last, 0xFF, sizeof(last));
+	while (__atomic_load_n(&consumed, __ATOMIC_RELAXED) < (TASKS * (count / 10))) {
+		csp_qfifo_t input[CSP_QFIFO_POLL_BUDGET];
+		const int n = csp_qfifo_read_bulk(0, input, CSP_QFIFO_POLL_BUDGET, QFIFO_STALL_MS);
+		if (n == 0) {
+			/* Packets are queued, but the router was not woken up */
+			CHECK(0, "qfifo: router stalled, %u packets consumed", __atomic_load_n(&consumed, __ATOMIC_RELAXED));
+			csp_qfifo_wake_up_shard(0);
+			continue;
+		}
+		for (int i = 0; i < n; i++) {
+			if (input[i].packet == NULL) {
+				continue;
+			}
+			uint32_t item;
+			memcpy(&item, input[i].packet->data, sizeof(item));
+			csp_buffer_free(input[i].packet);
+			item_check(item, last);
+			if ((item >> 24) < TASKS) {
+				__atomic_add_fetch(&qfifo_consumed[item >> 24], 1, __ATOMIC_RELEASE);
+			}
+		}
+	}
+	wait_done(TASKS);
+
+	seen_check("qfifo", count / 10);
+}
+
+int main(int argc, char * argv[]) {
+
+	int opt;
+	while ((opt = getopt(argc, argv, "n:h")) != -1) {
+		switch (opt) {
+			case 'n':
+				count = atoi(optarg);
+				break;
+			default:
+				printf(USAGE, argv[0]);
+				exit(1);
+		}
+	}
+
+	if ((count == 0) || (count >= (1UL << SEQ_BITS))) {
+		printf("Invalid count: %u\n", count);
+		exit(1);
+	}
+
+	csp_conf_t csp_conf;
+	csp_conf_get_defaults(&csp_conf);
+	csp_conf.address = 1;
+	csp_conf.conn_max = CONN_MAX;
+	csp_conf.buffers = TASKS * CSP_QFIFO_POLL_BUDGET;
+	if (csp_init(&csp_conf) != CSP_ERR_NONE) {
+		printf("csp_init() failed\n");
+		exit(1);
+	}
+
+	for (unsigned int i = 0; i < TASKS; i++) {
+		seen[i] = calloc((count + 31) / 32, sizeof(uint32_t));
+	}
+
+	static const struct {
+		const char * name;
+		void (*test)(void);
+	} tests[] = {
+		{"queue", test_queue},
+		{"pqueue", test_pqueue},
+		{"conn", test_conn},
+		{"timer", test_timer},
+		{"qfifo", test_qfifo},
+	};
+
+	for (unsigned int i = 0; i < (sizeof(tests) / sizeof(tests[0])); i++) {
+		const unsigned int before = errors;
+		const uint32_t start = csp_get_ms();
+		tests[i].test();
+		printf("%-8s %s (%u ms)\n", tests[i].name, (errors == before) ? "OK" : "FAILED", (unsigned int) (csp_get_ms() - start));
+	}
+
+	return (errors == 0) ? 0 : 1;
+}
@@ -27,6 +27,7 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
    Memory interface.
 */
 
+#include <stdint.h>
 #include <sys/types.h>
 #include <csp/csp_platform.h>
 
@@ -55,6 +56,34 @@ void * csp_calloc(size_t nmemb, size_t size);
 */
 void csp_free(void * ptr);
 
+/**
+   @defgroup CSP_MALLOC_POOL_FLAGS Options for csp_malloc_pool().
+   @{
+*/
+#define CSP_MALLOC_HUGEPAGE		0x01 //!< Back memory with huge pages, falls back to normal pages if not available
+#define CSP_MALLOC_PREFAULT		0x02 //!< Fault in all pages at allocation, instead of on first use
+#define CSP_MALLOC_LOCK			0x04 //!< Lock memory in RAM (implies #CSP_MALLOC_PREFAULT)
+#define CSP_MALLOC_NUMA_BIND		0x08 //!< Returned only: memory is bound to the requested NUMA node
+/**@}*/
+
+/**
+   Allocate large, long lived chunk of memory, e.g. buffer pools.
+   The options are only supported on Linux, other platforms use csp_malloc() and clear all options.
+   @param[in] size size of memory chunk (bytes).
+   @param[in,out] flags requested options, see @ref CSP_MALLOC_POOL_FLAGS. On return, the options actually applied, which must be passed to csp_free_pool().
+   @param[in] numa_node bind memory to NUMA node, -1 for no binding. #CSP_MALLOC_NUMA_BIND is set in \a flags if the binding was applied.
+   @return Pointer to allocated memory, or NULL on failure.
+*/
+void * csp_malloc_pool(size_t size, uint32_t * flags, int numa_node);
+
+/**
+   Free memory allocated by csp_malloc_pool().
+   @param[in] ptr memory to free. NULL pointer is ignored.
+   @param[in] size size of memory chunk, as passed to csp_malloc_pool().
+   @param[in] flags options applied, as returned by csp_malloc_pool().
+*/
+void csp_free_pool(void * ptr, size_t size, uint32_t flags);
+
 #ifdef __cplusplus
 }
 #endif
@@ -109,6 +109,39 @@ int csp_queue_dequeue(csp_queue_handle_t handle, void *buf, uint32_t timeout);
 */
 int csp_queue_dequeue_isr(csp_queue_handle_t handle, void * buf, CSP_BASE_TYPE * pxTaskWoken);
 
+/**
+   Enqueue (back) multiple values.
+   The values are added in one operation (single lock/critical section), as many as there is room for.
+   @param[in] handle queue.
+   @param[in] values array of values to add (by copy).
+   @param[in] count number of values in \a values.
+   @param[in] timeout timeout, time to wait for free space (for at least one value).
+   @return number of values added, 0 on timeout or error.
+*/
+int csp_queue_enqueue_bulk(csp_queue_handle_t handle, const void * values, int count, uint32_t timeout);
+
+/**
+   Dequeue multiple values (front).
+   The values are extracted in one operation (single lock/critical section), as many as available.
+   @param[in] handle queue.
+   @param[out] buf array for extracted elements (by copy), room for \a count elements.
+   @param[in] count max number of elements to extract.
+   @param[in] timeout timeout, time to wait for (at least one) element in queue.
+   @return number of elements extracted, 0 on timeout or error.
+*/
+int csp_queue_dequeue_bulk(csp_queue_handle_t handle, void * buf, int count, uint32_t timeout);
+
+/**
+   Peek at multiple values, without removing them from the queue.
+   The values are copied in one operation (single lock/critical section), as many as available.
+   @param[in] handle queue.
+   @param[out] buf array for copied elements, room for \a count elements.
+   @param[in] first index of the first element to copy, 0 is the front of the queue.
+   @param[in] count max number of elements to copy.
+   @return number of elements copied, 0 if the queue holds no elements from \a first.
+*/
+int csp_queue_peek_range(csp_queue_handle_t handle, void * buf, int first, int count);
+
 /**
    Queue size.
    @param[in] handle queue.
@@ -81,6 +81,10 @@ typedef struct pthread_queue_s {
 	pthread_cond_t cond_full;
 	//! Wait because queue is empty (extract).
 	pthread_cond_t cond_empty;
+	//! Threads waiting on cond_full.
+	int waiting_full;
+	//! Threads waiting on cond_empty.
+	int waiting_empty;
 } pthread_queue_t;
 
 /**
@@ -103,6 +107,24 @@ int pthread_queue_enqueue(pthread_queue_t * queue, const void * value, uint32_t
 */
 int pthread_queue_dequeue(pthread_queue_t * queue, void * buf, uint32_t timeout);
 
+/**
+   Enqueue/insert multiple elements, as many as there is room for.
+   @return number of elements inserted.
+*/
+int pthread_queue_enqueue_bulk(pthread_queue_t * queue, const void * values, int count, uint32_t timeout);
+
+/**
+   Dequeue/extract multiple elements, as many as available.
+   @return number of elements extracted.
+*/
+int pthread_queue_dequeue_bulk(pthread_queue_t * queue, void * buf, int count, uint32_t timeout);
+
+/**
+   Copy multiple elements, starting at index \a first from the front, without extracting them.
+   @return number of elements copied.
+*/
+int pthread_queue_peek_range(pthread_queue_t * queue, void * buf, int first, int count);
+
 /**
    Return number of elements in the queue.
 */
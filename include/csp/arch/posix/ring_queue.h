@@ -0,0 +1,98 @@
+/*
+Cubesat Space Protocol - A small network-layer protocol designed for Cubesats
+Copyright (C) 2012 Gomspace ApS (http://www.gomspace.com)
+Copyright (C) 2012 AAUSAT3 Project (http://aausat3.space.aau.dk) 
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef _CSP_ARCH_POSIX_RING_QUEUE_H_
+#define _CSP_ARCH_POSIX_RING_QUEUE_H_
+
+/**
+   @file
+
+   Lock-free bounded queue (Linux).
+
+   Multi-producer/multi-consumer ring buffer, where each slot has a sequence number telling if it is free or
+   filled for the current lap (D. Vyukov's bounded MPMC queue). Enqueue/dequeue claims a slot with a single
+   compare-and-swap, and only blocks (futex) when the queue is full or empty. Waiters are counted, so the
+   futex is only woken if a thread is actually waiting.
+*/
+
+#include <stdint.h>
+#include <csp/arch/csp_queue.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+   Queue handle.
+*/
+typedef struct ring_queue_s ring_queue_t;
+
+/**
+   Create queue.
+*/
+ring_queue_t * ring_queue_create(int length, size_t item_size);
+
+/**
+   Delete queue.
+*/
+void ring_queue_delete(ring_queue_t * q);
+
+/**
+   Enqueue/insert element.
+   @return #CSP_QUEUE_OK on success, otherwise #CSP_QUEUE_ERROR (full/timeout).
+*/
+int ring_queue_enqueue(ring_queue_t * queue, const void * value, uint32_t timeout);
+
+/**
+   Dequeue/extract element.
+   @return #CSP_QUEUE_OK on success, otherwise #CSP_QUEUE_ERROR (empty/timeout).
+*/
+int ring_queue_dequeue(ring_queue_t * queue, void * buf, uint32_t timeout);
+
+/**
+   Enqueue/insert multiple elements, as many as there is room for.
+   @return number of elements inserted.
+*/
+int ring_queue_enqueue_bulk(ring_queue_t * queue, const void * values, int count, uint32_t timeout);
+
+/**
+   Dequeue/extract multiple elements, as many as available.
+   @return number of elements extracted.
+*/
+int ring_queue_dequeue_bulk(ring_queue_t * queue, void * buf, int count, uint32_t timeout);
+
+/**
+   Copy multiple elements, starting at index \a first from the front, without extracting them.
+   Copying stops at the first element that is extracted (or not yet inserted) while copying.
+   @return number of elements copied.
+*/
+int ring_queue_peek_range(ring_queue_t * queue, void * buf, int first, int count);
+
+/**
+   Return number of elements in the queue.
+   The number is a snapshot, and may be off while other threads enqueue/dequeue.
+*/
+int ring_queue_items(ring_queue_t * queue);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _CSP_ARCH_POSIX_RING_QUEUE_H_
@@ -43,6 +43,62 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
 extern "C" {
 #endif
 
+/**
+   Max number of buffer size classes, see csp_conf_t.buffer_classes.
+*/
+#define CSP_BUFFER_CLASSES_MAX	8
+
+/**
+   Buffer size class.
+*/
+typedef struct csp_buffer_class_s {
+	uint16_t data_size;			/**< Data size of buffers in this class */
+	uint16_t buffers;			/**< Number of buffers in this class, at least 1. The total over all classes must fit in csp_conf_t.buffers */
+} csp_buffer_class_t;
+
+/**
+   Queue statistics, see csp_route_get_queue_stats() and csp_conn_get_queue_stats().
+*/
+typedef struct csp_queue_stats_s {
+	uint32_t tail_drops;			/**< Packets dropped, because the queue was full */
+	uint32_t aqm_drops;			/**< Packets dropped by active queue management, see csp_conf_t.aqm_target */
+	uint32_t sojourn;			/**< Time (mS) the last dequeued packet spent in the queue (AQM only) */
+	uint32_t sojourn_max;			/**< Max time (mS) a packet spent in the queue (AQM only) */
+} csp_queue_stats_t;
+
+/**
+   Router stages, see csp_route_get_latency().
+*/
+typedef enum {
+	CSP_ROUTE_STAGE_QUEUE,			/**< Waiting in the router queue, from csp_qfifo_write() until routed */
+	CSP_ROUTE_STAGE_SECURITY,		/**< Decryption and verification (XTEA, CRC32, HMAC) of incoming packets */
+	CSP_ROUTE_STAGE_DELIVERY,		/**< Delivery of incoming packets to a socket or connection (incl. RDP) */
+	CSP_ROUTE_STAGE_EGRESS,			/**< Sending packets, csp_send_direct() incl. rate limits and next hop */
+	CSP_ROUTE_STAGES			/**< Number of stages */
+} csp_route_stage_t;
+
+/**
+   Number of latency histogram buckets.
+   Buckets 0-3 count 0-3 mS, after which each power of 2 is split in 4 buckets (4-4, 5-5, 6-6, 7-7, 8-9, ... 14-15,
+   16-19, ...). The last bucket also counts all larger values (> 114 seconds).
+*/
+#define CSP_LATENCY_BUCKETS		64
+
+/**
+   Latency histogram, see csp_route_get_latency().
+*/
+typedef struct csp_latency_s {
+	uint32_t count;				/**< Number of packets */
+	uint32_t total;				/**< Sum of latencies (mS), for the mean */
+	uint32_t max;				/**< Max latency (mS) */
+	uint32_t buckets[CSP_LATENCY_BUCKETS];	/**< Number of packets per latency range */
+} csp_latency_t;
+
+/**
+   Max value of csp_conf_t.conn_max.
+*/
+#define CSP_CONN_MAX		0xFFFE
+
 /**
    CSP configuration.
    @see csp_init()
@@ -54,13 +110,25 @@ typedef struct csp_conf_s {
 	const char *model;			/**< Model, returned by the #CSP_CMP_IDENT request */
 	const char *revision;		/**< Revision, returned by the #CSP_CMP_IDENT request */
 
-	uint8_t conn_max;			/**< Max number of connections. A fixed connection array is allocated by csp_init() */
-	uint8_t conn_queue_length;	/**< Max queue length (max queued Rx messages). */
+	uint16_t conn_max;			/**< Max number of connections (max #CSP_CONN_MAX). A fixed connection array is allocated by csp_init(), connection queues are created when a connection is first used */
+	uint16_t conn_queue_length;	/**< Max queue length (max queued Rx messages). */
 	uint8_t fifo_length;		/**< Length of incoming message queue, used for handover to router task. */
+	uint8_t fifo_weights[CSP_PRIORITIES];	/**< Router scheduling weight per priority (#CSP_USE_QOS only). Priorities with weight 0 are routed first (strict priority), priorities with a weight share the rest using deficit round robin, routing up to weight packets per round. All 0 (default) for strict priority. */
+	uint8_t fifo_iface_max;		/**< Max packets from a single interface waiting in the router queues, further packets from the interface are dropped. 0 for no limit. */
+	uint16_t aqm_target;		/**< Active queue management (CoDel) target delay (mS) for the router queues and connection queues (except RDP). Packets are dropped early when the queue delay stays above target. 0 disables AQM (tail drop only). */
+	uint16_t aqm_interval;		/**< Active queue management (CoDel) interval (mS), should be about the round trip time of the traffic. */
+	uint8_t router_workers;		/**< Number of router workers started by csp_route_start_task(). Packets are sharded by connection (#CSP_ID_CONN_MASK), so a connection is always handled by the same worker. 0 or 1 for a single router task. */
 	uint8_t port_max_bind;		/**< Max/highest port for use with csp_bind() */
 	uint8_t rdp_max_window;		/**< Max RDP window size */
 	uint16_t buffers;			/**< Number of CSP buffers */
 	uint16_t buffer_data_size;	/**< Data size of a CSP buffer. Total size will be sizeof(#csp_packet_t) + data_size. */
+	const csp_buffer_class_t *buffer_classes;	/**< Optional buffer size classes, sorted by increasing data size. If set, #buffers and #buffer_data_size are ignored (csp_init() sets them to the total number of buffers and the largest data size) and csp_buffer_get() uses the smallest class fitting the requested size. Only read by csp_init(). */
+	uint8_t buffer_class_count;	/**< Number of entries in #buffer_classes, max #CSP_BUFFER_CLASSES_MAX */
+	uint8_t buffer_cache_size;	/**< Number of free buffers cached per thread (magazine), serving csp_buffer_get()/csp_buffer_free() without locking. 0 disables the cache. Only supported on POSIX/MacOSX. */
+	uint16_t buffer_headroom;	/**< Extra room reserved in front of each #csp_packet_t, in addition to #csp_packet_t.padding and #csp_packet_t.length, for link headers added with csp_packet_push() */
+	uint16_t buffer_tailroom;	/**< Extra room reserved after the data part of each buffer, for trailers (CRC32, HMAC, RDP header, etc.) added with csp_packet_put() */
+	uint8_t buffer_mem_flags;	/**< Buffer pool memory options (huge pages, pre-fault, lock), see @ref CSP_MALLOC_POOL_FLAGS in csp/arch/csp_malloc.h. Options not available are ignored (with a warning). */
+	int8_t buffer_numa_node;	/**< Bind buffer pool memory to this NUMA node (Linux only), -1 for no binding. A warning is logged if the binding is not applied. */
 	uint32_t conn_dfl_so;		/**< Default connection options. Options will always be or'ed onto new connections, see csp_connect() */
 } csp_conf_t;
 
@@ -75,10 +143,24 @@ static inline void csp_conf_get_defaults(csp_conf_t * conf) {
 	conf->conn_max = 10;
 	conf->conn_queue_length = 10;
 	conf->fifo_length = 25;
+	for (int prio = 0; prio < CSP_PRIORITIES; prio++) {
+		conf->fifo_weights[prio] = 0;
+	}
+	conf->fifo_iface_max = 0;
+	conf->aqm_target = 0;
+	conf->aqm_interval = 100;
+	conf->router_workers = 1;
 	conf->port_max_bind = 24;
 	conf->rdp_max_window = 20;
 	conf->buffers = 10;
 	conf->buffer_data_size = 256;
+	conf->buffer_classes = NULL;
+	conf->buffer_class_count = 0;
+	conf->buffer_cache_size = 0;
+	conf->buffer_headroom = 0;
+	conf->buffer_tailroom = 0;
+	conf->buffer_mem_flags = 0;
+	conf->buffer_numa_node = -1;
 	conf->conn_dfl_so = CSP_O_NONE;
 }
 
@@ -208,6 +290,34 @@ int csp_transaction_persistent(csp_conn_t *conn, uint32_t timeout, void *outbuf,
 */
 csp_packet_t *csp_recvfrom(csp_socket_t *socket, uint32_t timeout);
 
+/**
+   Poll result: ready, see csp_poll().
+*/
+#define CSP_POLLIN		0x01
+
+/**
+   Poll entry, see csp_poll().
+*/
+typedef struct csp_pollfd_s {
+	csp_conn_t *conn;			/**< Connection, socket or NULL for the promiscuous queue (see csp_promisc_enable()) */
+	uint8_t revents;			/**< Set by csp_poll(), #CSP_POLLIN if ready */
+} csp_pollfd_t;
+
+/**
+   Wait until one or more sockets, connections or the promiscuous queue are ready.
+
+   Ready means, that the following call will not block: csp_accept() for a socket, csp_recvfrom() for a
+   connection-less socket, csp_read() for a connection and csp_promisc_read() for the promiscuous queue.
+   The call may still return NULL, e.g. if the packet was dropped by active queue management.
+   A socket, connection or the promiscuous queue can only be polled by one task at a time.
+
+   @param[in,out] fds entries to poll, \a revents is set on return.
+   @param[in] count number of entries.
+   @param[in] timeout timeout in mS to wait, use #CSP_MAX_TIMEOUT for infinite timeout, 0 to check without waiting.
+   @return number of ready entries, 0 on timeout, otherwise an error code (#CSP_ERR_BUSY if polled by another task).
+*/
+int csp_poll(csp_pollfd_t *fds, unsigned int count, uint32_t timeout);
+
 /**
    Send a packet (without connection).
    @param[in] prio packet priority, see #csp_prio_t
@@ -288,6 +398,14 @@ int csp_conn_src(csp_conn_t *conn);
 */
 int csp_conn_flags(csp_conn_t *conn);
 
+/**
+   Return connection RX queue statistics.
+   @param[in] conn connection
+   @param[out] stats statistics
+   @return #CSP_ERR_NONE on success, otherwise an error code.
+*/
+int csp_conn_get_queue_stats(csp_conn_t *conn, csp_queue_stats_t * stats);
+
 /**
    Set socket to listen for incoming connections.
    @param[in] socket socket
@@ -310,8 +428,8 @@ int csp_bind(csp_socket_t *socket, uint8_t port);
 CSP_DEFINE_TASK(csp_task_router);
 
 /**
-   Start the router task.
-   The router task calls csp_route_work() to do the actual work.
+   Start the router task(s).
+   One task is started per router worker (csp_conf_t.router_workers), each calling csp_route_work_shard() to do the actual work.
    @param[in] task_stack_size stack size for the task, see csp_thread_create() for details on the stack size parameter.
    @param[in] task_priority priority for the task, see csp_thread_create() for details on the stack size parameter.
    @return #CSP_ERR_NONE on success, otherwise an error code.
@@ -322,11 +440,51 @@ int csp_route_start_task(unsigned int task_stack_size, unsigned int task_priorit
    Route packet from the incoming router queue and check RDP timeouts.
    In order for incoming packets to routed and RDP timeouts to be checked, this function must be called reguarly.
    If the router task is started by calling csp_route_start_task(), there function should not be called.
-   @param[in] timeout timeout in mS to wait for an incoming packet.
-   @return #CSP_ERR_NONE on success, otherwise an error code.
+   Only for a single router shard (csp_conf_t.router_workers 0 or 1), otherwise use csp_route_work_shard() for each shard.
+   @param[in] timeout timeout in mS to wait for an incoming packet, shortened to the next RDP timeout.
+   @return #CSP_ERR_NONE on success, #CSP_ERR_INVAL if there are several router shards, otherwise an error code.
 */
 int csp_route_work(uint32_t timeout);
 
+/**
+   Route packet from the incoming router queue of a router shard, and check RDP timeouts for the connections in the shard.
+   Each shard must be served by one task only, in order to keep connections single-threaded.
+   @param[in] shard router shard, 0 to csp_conf_t.router_workers - 1.
+   @param[in] timeout timeout in mS to wait for an incoming packet, shortened to the next RDP timeout.
+   @return #CSP_ERR_NONE on success, otherwise an error code.
+*/
+int csp_route_work_shard(unsigned int shard, uint32_t timeout);
+
+/**
+   Return router queue statistics.
+   @param[in] shard router shard, 0 to csp_conf_t.router_workers - 1.
+   @param[out] stats statistics
+   @return #CSP_ERR_NONE on success, otherwise an error code.
+*/
+int csp_route_get_queue_stats(unsigned int shard, csp_queue_stats_t * stats);
+
+/**
+   Return router latency histogram for a stage.
+   Only available if compiled with CSP_USE_STATS. Latencies are measured with csp_get_ms(), i.e. in whole mS.
+   @param[in] stage router stage.
+   @param[out] latency histogram.
+   @return #CSP_ERR_NONE on success, otherwise an error code (#CSP_ERR_NOTSUP if not compiled with CSP_USE_STATS).
+*/
+int csp_route_get_latency(csp_route_stage_t stage, csp_latency_t * latency);
+
+/**
+   Reset router latency histograms for all stages.
+*/
+void csp_route_reset_latency(void);
+
+/**
+   Return latency percentile from histogram.
+   @param[in] latency histogram.
+   @param[in] permille percentile in 1/1000, e.g. 990 for the 99th percentile.
+   @return latency (mS), upper bound of the histogram bucket containing the percentile.
+*/
+uint32_t csp_latency_percentile(const csp_latency_t * latency, unsigned int permille);
+
 /**
    Start the bridge task.
    The bridge will copy packets between interfaces, i.e. packets received on A will be sent on B, and vice versa.
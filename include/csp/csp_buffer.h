@@ -37,6 +37,9 @@ extern "C" {
 /**
    Get free buffer (from task context).
 
+   If buffer size classes are configured, the buffer is taken from the smallest class fitting \a data_size (or a larger
+   class, if the smallest is exhausted).
+
    @param[in] data_size minimum data size of requested buffer.
    @return Buffer (pointer to #csp_packet_t) or NULL if no buffers available or size too big.
 */
@@ -52,6 +55,7 @@ void * csp_buffer_get_isr(size_t data_size);
 
 /**
    Free buffer (from task context).
+   If \a buffer is the first segment of a chained packet, the remaining segments are freed too, see csp_packet_chain().
    @param[in] buffer buffer to free. NULL is handled gracefully.
 */
 void csp_buffer_free(void *buffer);
@@ -62,34 +66,179 @@ void csp_buffer_free(void *buffer);
 */
 void csp_buffer_free_isr(void *buffer);
 
+/**
+   Get multiple free buffers (from task context).
+
+   The buffers are taken from the pool in as few operations as possible (a single lock, if the pool holds enough
+   buffers), instead of one csp_buffer_get() per buffer.
+
+   @param[in] data_size minimum data size of requested buffers.
+   @param[in] count number of buffers requested.
+   @param[out] buffers array of at least \a count entries, filled with the buffers (pointers to #csp_packet_t).
+   @return number of buffers returned in \a buffers, may be less than \a count if out of buffers.
+*/
+int csp_buffer_get_bulk(size_t data_size, unsigned int count, void * buffers[]);
+
+/**
+   Free multiple buffers (from task context).
+   Buffers released to the same pool are returned in batches, instead of one csp_buffer_free() per buffer.
+   @param[in] count number of buffers in \a buffers.
+   @param[in] buffers buffers to free. NULL entries are handled gracefully.
+*/
+void csp_buffer_free_bulk(unsigned int count, void * buffers[]);
+
 /**
    Clone an existing buffer.
-   The existing \a buffer content is copied to the new buffer.
+   The existing \a buffer content is copied to a new buffer of the same size class (all segments, if chained).
    @param[in] buffer buffer to clone.
    @return cloned buffer on success, or NULL on failure.
 */
 void * csp_buffer_clone(void *buffer);
 
+/**
+   Add a reference to a buffer.
+   The buffer is shared instead of copied, and is not returned to the pool until csp_buffer_free() has been called
+   once for each reference. A shared buffer must be treated as read-only, see csp_buffer_writable().
+   @param[in] buffer buffer to reference.
+   @return \a buffer, or NULL if \a buffer is not a valid (allocated) buffer.
+*/
+void * csp_buffer_ref(void *buffer);
+
+/**
+   Get a writable buffer.
+   If \a buffer is not shared (see csp_buffer_ref()), \a buffer is returned. Otherwise a clone is returned, and the
+   caller must release its reference to \a buffer with csp_buffer_free() once the clone is used.
+   @param[in] buffer buffer to modify.
+   @return \a buffer or a clone of it, NULL if out of buffers (\a buffer is not released).
+*/
+void * csp_buffer_writable(void *buffer);
+
 /**
    Return number of remaining/free buffers.
-   The number of buffers is set by csp_init().
+   The number of buffers is set by csp_init(). Free buffers held in per-thread caches are included, see csp_conf_t.buffer_cache_size.
    @return number of remaining/free buffers
 */
 int csp_buffer_remaining(void);
 
 /**
-   Return the size of a CSP buffer.
-   @return size of a CSP buffer, sizeof(#csp_packet_t) + data_size.
+   Return the size of the largest CSP buffer.
+   @return size of the largest CSP buffer, sizeof(#csp_packet_t) + data_size.
 */
 size_t csp_buffer_size(void);
 
 /**
-   Return the data size of a CSP buffer.
+   Return the data size of the largest CSP buffer.
    The data size is set by csp_init().
-   @return data size of a CSP buffer
+   @return data size of the largest CSP buffer
 */
 size_t csp_buffer_data_size(void);
 
+/**
+   Return the data size of a specific buffer.
+   With buffer size classes, this may be less than csp_buffer_data_size().
+   @param[in] buffer buffer returned by csp_buffer_get().
+   @return data size of \a buffer, 0 if \a buffer is NULL.
+*/
+size_t csp_buffer_data_size_of(const void * buffer);
+
+/**
+   Return room available in front of the packet head.
+   The head is initially #csp_packet_t.id, and the room in front of it is #csp_packet_t.padding, #csp_packet_t.length
+   and csp_conf_t.buffer_headroom.
+   @param[in] packet packet returned by csp_buffer_get().
+   @return number of bytes that can be added with csp_packet_push().
+*/
+size_t csp_packet_headroom(const csp_packet_t * packet);
+
+/**
+   Return room available after the packet data.
+   The room is the data size of the buffer (see csp_buffer_data_size_of()) plus csp_conf_t.buffer_tailroom, minus
+   #csp_packet_t.length.
+   @param[in] packet packet returned by csp_buffer_get().
+   @return number of bytes that can be added with csp_packet_put().
+*/
+size_t csp_packet_tailroom(const csp_packet_t * packet);
+
+/**
+   Add header in front of the packet head (in place).
+   Intended for link headers, which are sent together with #csp_packet_t.id and data (zero copy).
+
+   @note The header overlays #csp_packet_t.length, so the length must be read before pushing a header.
+   @param[in] packet packet, must not be shared (see csp_buffer_writable()).
+   @param[in] len number of bytes to add.
+   @return pointer to the added header (the new head), or NULL if not enough headroom or the packet is shared.
+*/
+void * csp_packet_push(csp_packet_t * packet, size_t len);
+
+/**
+   Remove header from the packet head, reversing csp_packet_push().
+   Used on receive, to strip a link header received in front of #csp_packet_t.id.
+   @param[in] packet packet.
+   @param[in] len number of bytes to remove.
+   @return pointer to the removed header, or NULL if \a len is more than previously pushed.
+*/
+void * csp_packet_pull(csp_packet_t * packet, size_t len);
+
+/**
+   Add trailer after the packet data (in place), and increase #csp_packet_t.length.
+   @param[in] packet packet, must not be shared (see csp_buffer_writable()).
+   @param[in] len number of bytes to add.
+   @return pointer to the added trailer, or NULL if not enough tailroom or the packet is shared.
+*/
+void * csp_packet_put(csp_packet_t * packet, size_t len);
+
+/**
+   Remove trailer from the end of the packet data, and decrease #csp_packet_t.length.
+   @param[in] packet packet.
+   @param[in] len number of bytes to remove.
+   @return pointer to the removed trailer (still valid until the packet is modified or freed), or NULL if \a len
+   is more than #csp_packet_t.length.
+*/
+void * csp_packet_trim(csp_packet_t * packet, size_t len);
+
+/**
+   Return next segment of a chained packet.
+   A chained packet carries a message larger than a single buffer. The first segment holds the CSP id, and the
+   data of the message is the data of all segments in order (each segment's #csp_packet_t.length bytes).
+   @param[in] packet packet or segment.
+   @return next segment, or NULL if \a packet is the last (or only) segment.
+*/
+csp_packet_t * csp_packet_next(const csp_packet_t * packet);
+
+/**
+   Append segment to the end of a packet chain.
+   The chain takes over the reference to \a segment, which is freed together with \a packet by csp_buffer_free().
+   @param[in] packet first segment, must not be shared (see csp_buffer_writable()).
+   @param[in] segment segment (or chain of segments) to append.
+   @return #CSP_ERR_NONE on success, otherwise an error code.
+*/
+int csp_packet_chain(csp_packet_t * packet, csp_packet_t * segment);
+
+/**
+   Return total data length of a (chained) packet.
+   @param[in] packet first segment.
+   @return sum of #csp_packet_t.length of all segments.
+*/
+size_t csp_packet_chain_length(const csp_packet_t * packet);
+
+/**
+   Get a chain of buffers for \a length bytes of data (from task context).
+   Each segment is a buffer of the largest size class, except the last, and has #csp_packet_t.length set to the
+   number of bytes it holds.
+   @param[in] length total data length.
+   @return first segment, or NULL if out of buffers.
+*/
+csp_packet_t * csp_buffer_get_chain(size_t length);
+
+/**
+   Get a linear (not chained) copy of a chained packet.
+   If \a packet is not chained, \a packet is returned. Otherwise the id and data of all segments is copied to a new
+   buffer, and the caller must release its reference to \a packet with csp_buffer_free() once the copy is used.
+   @param[in] packet first segment.
+   @return \a packet or a linear copy, NULL if out of buffers or the data does not fit in a single buffer.
+*/
+csp_packet_t * csp_packet_linearize(csp_packet_t * packet);
+
 #ifdef __cplusplus
 }
 #endif
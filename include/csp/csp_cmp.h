@@ -81,6 +81,10 @@ extern "C" {
    Get/set clock.
 */
 #define CSP_CMP_CLOCK 6
+/**
+   Request router latency statistics (requires CSP_USE_STATS).
+*/
+#define CSP_CMP_ROUTE_LATENCY 7
 /**@}*/
 
 /**
@@ -156,6 +160,16 @@ struct csp_cmp_message {
 			char data[CSP_CMP_POKE_MAX_LEN];
 		} poke;
 		csp_timestamp_t clock;
+		struct CSP_COMPILER_PACKED {
+			uint8_t stage;		//!< Router stage, see #csp_route_stage_t
+			uint32_t count;
+			uint32_t max;		//!< mS
+			uint32_t mean;		//!< mS
+			uint32_t p50;		//!< mS, see csp_latency_percentile()
+			uint32_t p90;
+			uint32_t p99;
+			uint32_t p999;
+		} route_latency;
 	};
 } CSP_COMPILER_PACKED;
 
@@ -190,6 +204,7 @@ CMP_MESSAGE(CSP_CMP_IDENT, ident)
 CMP_MESSAGE(CSP_CMP_ROUTE_SET, route_set)
 CMP_MESSAGE(CSP_CMP_IF_STATS, if_stats)
 CMP_MESSAGE(CSP_CMP_CLOCK, clock)
+CMP_MESSAGE(CSP_CMP_ROUTE_LATENCY, route_latency)
 
 /**
    Peek (read) memory on remote node.
@@ -58,6 +58,7 @@ struct csp_iface_s {
 	nexthop_t nexthop;		   //!< Next hop (Tx) function
 	uint16_t mtu;			   //!< Maximum Transmission Unit of interface
 	uint8_t split_horizon_off; //!< Disable the route-loop prevention
+	uint8_t chained;		   //!< Next hop function accepts chained packets (see csp_packet_next()), otherwise they are linearized
 	uint32_t tx;			   //!< Successfully transmitted packets
 	uint32_t rx;			   //!< Successfully received packets
 	uint32_t tx_error;		   //!< Transmit errors (packets)
@@ -68,6 +69,14 @@ struct csp_iface_s {
 	uint32_t txbytes;		   //!< Transmitted bytes
 	uint32_t rxbytes;		   //!< Received bytes
 	uint32_t irq;			   //!< Interrupts
+	uint32_t fifo_queued;	   //!< Internal, packets waiting in the router queues (only counted if csp_conf_t.fifo_iface_max is set)
+	uint32_t fifo_drop;		   //!< Packets dropped, because the interface's share of the router queues was used (see csp_conf_t.fifo_iface_max)
+	uint32_t tx_queue_drop;	   //!< Packets dropped, because the egress queue was full (see csp_iface_start_tx_task())
+	uint32_t rx_queue_drop;	   //!< Packets dropped, because the ingress queue was full (see csp_iface_set_rx_queue())
+	void * tx_queue;		   //!< Internal, egress queue (see csp_iface_start_tx_task())
+	void * rx_queue;		   //!< Internal, ingress queues (see csp_iface_set_rx_queue())
+	uint32_t rx_policed;	   //!< Packets dropped, because the receive rate limit was exceeded (see csp_iface_set_rate())
+	void * rate;			   //!< Internal, rate limits (see csp_iface_set_rate())
 	struct csp_iface_s *next;  //!< Internal, interfaces are stored in a linked list
 };
 //doc-end:csp_iface_s
@@ -89,6 +98,75 @@ struct csp_iface_s {
 */
 void csp_qfifo_write(csp_packet_t *packet, csp_iface_t *iface, CSP_BASE_TYPE *pxTaskWoken);
 
+/**
+   Start a transmit task for the interface.
+
+   Outgoing packets are queued on the interface (highest priority first), and the task calls the interface's next hop
+   function. Without a transmit task, the next hop function is called directly by the sending task (e.g. the router),
+   so a slow interface delays packets for other interfaces.
+   If the queue is full, the packet is dropped and counted in #csp_iface_s.tx_queue_drop.
+
+   Must be called after the interface has been initialized, and before any packets are sent on it.
+
+   @param[in] iface interface.
+   @param[in] queue_length max number of queued packets, per priority.
+   @param[in] task_stack_size stack size for the task, see csp_thread_create() for details on the stack size parameter.
+   @param[in] task_priority priority for the task, see csp_thread_create() for details on the priority parameter.
+   @return #CSP_ERR_NONE on success, otherwise an error code.
+*/
+int csp_iface_start_tx_task(csp_iface_t * iface, unsigned int queue_length, unsigned int task_stack_size, unsigned int task_priority);
+
+/**
+   Give the interface its own receive queues (one per router worker).
+
+   Packets from csp_qfifo_write() are queued on the interface instead of the shared router queues. Only the first packet
+   wakes up the router, which then polls the interface (a budget of packets per interface, round robin) until the queue
+   is empty - so a busy interface costs one wake-up per burst instead of one per packet, and can not fill the router
+   queues for other interfaces. Packets in the interface queue are routed in arrival order, regardless of priority.
+   If the queue is full, the packet is dropped and counted in #csp_iface_s.drop and #csp_iface_s.rx_queue_drop.
+
+   Must be called after csp_init() and after the interface has been added, and before any packets are received on it.
+
+   @param[in] iface interface.
+   @param[in] length max number of queued packets, per router worker.
+   @return #CSP_ERR_NONE on success, otherwise an error code.
+*/
+int csp_iface_set_rx_queue(csp_iface_t * iface, unsigned int length);
+
+/**
+   Set interface rate limits (token buckets).
+
+   Outgoing packets are paced at the transmit rate: a burst of up to \a tx_burst bytes is sent at once, after which
+   packets wait in the interface's egress queue until their bytes fit within the rate. A transmit rate therefore
+   requires the interface's transmit task (see csp_iface_start_tx_task()), so senders (e.g. the router) are never
+   delayed. Packets are only dropped if the egress queue is full.
+   Incoming packets exceeding the receive rate (burst \a rx_burst) are dropped by csp_qfifo_write(), and counted in
+   #csp_iface_s.rx_policed.
+
+   @param[in] iface interface.
+   @param[in] tx_rate transmit rate in bytes per second, 0 for no limit.
+   @param[in] tx_burst transmit burst size in bytes, should be at least the interface MTU.
+   @param[in] rx_rate receive rate in bytes per second, 0 for no limit.
+   @param[in] rx_burst receive burst size in bytes, should be at least the interface MTU.
+   @return #CSP_ERR_NONE on success, #CSP_ERR_INVAL if \a tx_rate is set and the transmit task is not started,
+   otherwise an error code.
+*/
+int csp_iface_set_rate(csp_iface_t * iface, uint32_t tx_rate, uint32_t tx_burst, uint32_t rx_rate, uint32_t rx_burst);
+
+/**
+   Set transmit rate limit (token bucket) for a destination node.
+
+   Packets to the node are paced as for csp_iface_set_rate(), on any interface with a transmit task (see
+   csp_iface_start_tx_task()) - e.g. to limit traffic to a node behind a slower link further along the route.
+   Packets sent on interfaces without a transmit task are not paced.
+
+   @param[in] node destination address.
+   @param[in] rate rate in bytes per second, 0 for no limit.
+   @param[in] burst burst size in bytes.
+   @return #CSP_ERR_NONE on success, otherwise an error code.
+*/
+int csp_node_set_rate(uint8_t node, uint32_t rate, uint32_t burst);
+
 #ifdef __cplusplus
 }
 #endif
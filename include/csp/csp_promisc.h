@@ -27,7 +27,7 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
    Promiscuous packet queue.
 
    These functions are used to enable promiscuous mode for incoming packets, e.g. router, bridge.
-   If enabled, a copy of all incoming packets are cloned (using csp_buffer_clone()) and placed in a
+   If enabled, a reference to all incoming packets are taken (using csp_buffer_ref()) and placed in a
    FIFO queue, that can be read using csp_promisc_read().
 */
 
@@ -54,6 +54,7 @@ void csp_promisc_disable(void);
    Get/dequeue packet from promiscuous packet queue.
 
    Returns the first packet from the promiscuous packet queue.
+   The packet may be shared with the router, use csp_buffer_writable() before modifying it.
    @param[in] timeout Timeout in ms to wait for a packet.
    @return Packet (free with csp_buffer_free() or re-use packet), NULL on error or timeout.
 */
@@ -106,6 +106,20 @@ static inline int csp_sfp_recv(csp_conn_t * conn, void ** dataout, int * datasiz
 	return csp_sfp_recv_fp(conn, dataout, datasize, timeout, NULL);
 }
 
+/**
+   Receive data over a CSP connection, as a chained packet.
+
+   This is the counterpart to the csp_sfp_send() and csp_sfp_send_own_memcpy(). Unlike csp_sfp_recv_fp(), the received
+   fragments are not copied to allocated memory, but returned as the segments of a chained packet (see csp_packet_next()).
+
+   @param[in] conn established connection for receiving SFP packets.
+   @param[out] packet received data on success, must be freed with csp_buffer_free(). The pointer will be NULL on failure.
+   @param[in] timeout timeout in ms to wait for csp_read()
+   @param[in] first_packet First packet of a SFP transfer. Use NULL to receive first packet on the connection.
+   @return #CSP_ERR_NONE on success, otherwise an error.
+*/
+int csp_sfp_recv_chain(csp_conn_t * conn, csp_packet_t ** packet, uint32_t timeout, csp_packet_t * first_packet);
+
 #ifdef __cplusplus
 }
 #endif
@@ -43,3 +43,15 @@ void * csp_calloc(size_t nmemb, size_t size) {
 void csp_free(void *ptr) {
 	vPortFree(ptr);
 }
+
+void * csp_malloc_pool(size_t size, uint32_t * flags, int numa_node) {
+	(void) numa_node;
+	*flags = 0;
+	return csp_malloc(size);
+}
+
+void csp_free_pool(void * ptr, size_t size, uint32_t flags) {
+	(void) size;
+	(void) flags;
+	csp_free(ptr);
+}
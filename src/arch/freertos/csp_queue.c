@@ -19,45 +19,133 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
 */
 
 #include <stdint.h>
+#include <string.h>
 #include <sys/types.h>
 
 #include <FreeRTOS.h>
 #include <queue.h> // FreeRTOS
+#include <task.h> // FreeRTOS
 
 #include <csp/arch/csp_queue.h>
+#include <csp/arch/csp_malloc.h>
+
+/* FreeRTOS queue and item size, needed for bulk operations */
+typedef struct {
+	QueueHandle_t queue;
+	size_t item_size;
+	uint8_t scratch[]; // one item, used by csp_queue_peek_range() in a critical section
+} csp_freertos_queue_t;
 
 csp_queue_handle_t csp_queue_create(int length, size_t item_size) {
-	return xQueueCreate(length, item_size);
+	csp_freertos_queue_t * q = csp_malloc(sizeof(*q) + item_size);
+	if (q == NULL) {
+		return NULL;
+	}
+	q->queue = xQueueCreate(length, item_size);
+	if (q->queue == NULL) {
+		csp_free(q);
+		return NULL;
+	}
+	q->item_size = item_size;
+	return q;
 }
 
 void csp_queue_remove(csp_queue_handle_t queue) {
-	vQueueDelete(queue);
+	csp_freertos_queue_t * q = queue;
+	vQueueDelete(q->queue);
+	csp_free(q);
 }
 
 int csp_queue_enqueue(csp_queue_handle_t handle, const void * value, uint32_t timeout) {
 	if (timeout != CSP_MAX_TIMEOUT)
 		timeout = timeout / portTICK_RATE_MS;
-	return xQueueSendToBack(handle, value, timeout);
+	return xQueueSendToBack(((csp_freertos_queue_t *) handle)->queue, value, timeout);
 }
 
 int csp_queue_enqueue_isr(csp_queue_handle_t handle, const void * value, CSP_BASE_TYPE * task_woken) {
-	return xQueueSendToBackFromISR(handle, value, task_woken);
+	return xQueueSendToBackFromISR(((csp_freertos_queue_t *) handle)->queue, value, task_woken);
 }
 
 int csp_queue_dequeue(csp_queue_handle_t handle, void * buf, uint32_t timeout) {
 	if (timeout != CSP_MAX_TIMEOUT)
 		timeout = timeout / portTICK_RATE_MS;
-	return xQueueReceive(handle, buf, timeout);
+	return xQueueReceive(((csp_freertos_queue_t *) handle)->queue, buf, timeout);
 }
 
 int csp_queue_dequeue_isr(csp_queue_handle_t handle, void * buf, CSP_BASE_TYPE * task_woken) {
-	return xQueueReceiveFromISR(handle, buf, task_woken);
+	return xQueueReceiveFromISR(((csp_freertos_queue_t *) handle)->queue, buf, task_woken);
+}
+
+/* FreeRTOS has no bulk operations, the scheduler is suspended while adding/extracting the items */
+int csp_queue_enqueue_bulk(csp_queue_handle_t handle, const void * values, int count, uint32_t timeout) {
+	csp_freertos_queue_t * q = handle;
+	const uint8_t * value = values;
+	if ((count <= 0) || (csp_queue_enqueue(handle, value, timeout) != pdTRUE)) {
+		return 0;
+	}
+	int i;
+	vTaskSuspendAll();
+	for (i = 1; i < count; i++) {
+		if (xQueueSendToBack(q->queue, value + (i * q->item_size), 0) != pdTRUE) {
+			break;
+		}
+	}
+	xTaskResumeAll();
+	return i;
+}
+
+int csp_queue_dequeue_bulk(csp_queue_handle_t handle, void * buf, int count, uint32_t timeout) {
+	csp_freertos_queue_t * q = handle;
+	uint8_t * value = buf;
+	if ((count <= 0) || (csp_queue_dequeue(handle, value, timeout) != pdTRUE)) {
+		return 0;
+	}
+	int i;
+	vTaskSuspendAll();
+	for (i = 1; i < count; i++) {
+		if (xQueueReceive(q->queue, value + (i * q->item_size), 0) != pdTRUE) {
+			break;
+		}
+	}
+	xTaskResumeAll();
+	return i;
+}
+
+/* FreeRTOS can only peek the front, so the queue is rotated once (in order) in a critical section. Interrupts are
+   masked, so an ISR can't enqueue meanwhile, and there is always room to put an item back. The time spent with
+   interrupts masked grows with the number of items in the queue. */
+int csp_queue_peek_range(csp_queue_handle_t handle, void * buf, int first, int count) {
+	csp_freertos_queue_t * q = handle;
+	uint8_t * value = buf;
+	if ((first < 0) || (count <= 0)) {
+		return 0;
+	}
+	int copied = 0;
+	taskENTER_CRITICAL();
+	const int items = uxQueueMessagesWaitingFromISR(q->queue);
+	for (int i = 0; i < items; i++) {
+		if (xQueueReceiveFromISR(q->queue, q->scratch, NULL) != pdTRUE) {
+			break;
+		}
+		if ((i >= first) && (copied < count)) {
+			memcpy(value + (copied * q->item_size), q->scratch, q->item_size);
+			copied++;
+		}
+		if (xQueueSendToBackFromISR(q->queue, q->scratch, NULL) != pdTRUE) {
+			/* Can't happen, an item was just received - keep the item (at the front) instead of losing it */
+			xQueueSendToFrontFromISR(q->queue, q->scratch, NULL);
+			copied = 0;
+			break;
+		}
+	}
+	taskEXIT_CRITICAL();
+	return copied;
 }
 
 int csp_queue_size(csp_queue_handle_t handle) {
-	return uxQueueMessagesWaiting(handle);
+	return uxQueueMessagesWaiting(((csp_freertos_queue_t *) handle)->queue);
 }
 
 int csp_queue_size_isr(csp_queue_handle_t handle) {
-	return uxQueueMessagesWaitingFromISR(handle);
+	return uxQueueMessagesWaitingFromISR(((csp_freertos_queue_t *) handle)->queue);
 }
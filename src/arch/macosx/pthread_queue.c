@@ -33,6 +33,27 @@ http://code.google.com/p/c-pthread-queue/
 
 #include <csp/arch/posix/pthread_queue.h>
 
+/* Wake as many waiters as there are new slots/items - only signal if someone is actually waiting */
+static inline void notify_waiters(pthread_cond_t * cond, int waiting, int count) {
+
+	if ((waiting == 0) || (count <= 0)) {
+		return;
+	}
+
+	if (count >= waiting) {
+		if (waiting == 1) {
+			pthread_cond_signal(cond);
+		} else {
+			pthread_cond_broadcast(cond);
+		}
+		return;
+	}
+
+	while (count--) {
+		pthread_cond_signal(cond);
+	}
+}
+
 pthread_queue_t * pthread_queue_create(int length, size_t item_size) {
 	
 	pthread_queue_t * q = malloc(sizeof(pthread_queue_t));
@@ -45,6 +66,8 @@ pthread_queue_t * pthread_queue_create(int length, size_t item_size) {
 			q->items = 0;
 			q->in = 0;
 			q->out = 0;
+			q->waiting_full = 0;
+			q->waiting_empty = 0;
 			if (pthread_mutex_init(&(q->mutex), NULL) || pthread_cond_init(&(q->cond_full), NULL) || pthread_cond_init(&(q->cond_empty), NULL)) {
 				free(q->buffer);
 				free(q);
@@ -100,8 +123,10 @@ int pthread_queue_enqueue(pthread_queue_t * queue, const void * value, uint32_t
 	/* Get queue lock */
 	pthread_mutex_lock(&(queue->mutex));
 	while (queue->items == queue->size) {
+		queue->waiting_full++;
 		ret = pthread_cond_timedwait(&(queue->cond_full), &(queue->mutex), &ts);
-		if (ret != 0) {
+		queue->waiting_full--;
+		if ((ret != 0) && (queue->items == queue->size)) {
 			pthread_mutex_unlock(&(queue->mutex));
 			return PTHREAD_QUEUE_FULL;
 		}
@@ -111,10 +136,11 @@ int pthread_queue_enqueue(pthread_queue_t * queue, const void * value, uint32_t
 	memcpy(queue->buffer+(queue->in * queue->item_size), value, queue->item_size);
 	queue->items++;
 	queue->in = (queue->in + 1) % queue->size;
+	const int waiting = queue->waiting_empty;
 	pthread_mutex_unlock(&(queue->mutex));
 	
 	/* Nofify blocked threads */
-	pthread_cond_broadcast(&(queue->cond_empty));
+	notify_waiters(&(queue->cond_empty), waiting, 1);
 	
 	return PTHREAD_QUEUE_OK;
 	
@@ -147,8 +173,10 @@ int pthread_queue_dequeue(pthread_queue_t * queue, void * buf, uint32_t timeout)
 	/* Get queue lock */
 	pthread_mutex_lock(&(queue->mutex));
 	while (queue->items == 0) {
+		queue->waiting_empty++;
 		ret = pthread_cond_timedwait(&(queue->cond_empty), &(queue->mutex), &ts);
-		if (ret != 0) {
+		queue->waiting_empty--;
+		if ((ret != 0) && (queue->items == 0)) {
 			pthread_mutex_unlock(&(queue->mutex));
 			return PTHREAD_QUEUE_EMPTY;
 		}
@@ -158,15 +186,137 @@ int pthread_queue_dequeue(pthread_queue_t * queue, void * buf, uint32_t timeout)
 	memcpy(buf, queue->buffer+(queue->out * queue->item_size), queue->item_size);
 	queue->items--;
 	queue->out = (queue->out + 1) % queue->size;
+	const int waiting = queue->waiting_full;
 	pthread_mutex_unlock(&(queue->mutex));
 	
 	/* Nofify blocked threads */
-	pthread_cond_broadcast(&(queue->cond_full));
+	notify_waiters(&(queue->cond_full), waiting, 1);
 
 	return PTHREAD_QUEUE_OK;
 	
 }
 
+static void get_deadline(struct timespec * ts, uint32_t timeout) {
+
+	clock_serv_t cclock;
+	mach_timespec_t mts;
+	host_get_clock_service(mach_host_self(), CALENDAR_CLOCK, &cclock);
+	clock_get_time(cclock, &mts);
+	mach_port_deallocate(mach_task_self(), cclock);
+	ts->tv_sec = mts.tv_sec;
+	ts->tv_nsec = mts.tv_nsec;
+
+	uint32_t sec = timeout / 1000;
+	uint32_t nsec = (timeout - 1000 * sec) * 1000000;
+
+	ts->tv_sec += sec;
+
+	if (ts->tv_nsec + nsec > 1000000000)
+		ts->tv_sec++;
+
+	ts->tv_nsec = (ts->tv_nsec + nsec) % 1000000000;
+}
+
+int pthread_queue_enqueue_bulk(pthread_queue_t * queue, const void * values, int count, uint32_t timeout) {
+
+	if (count <= 0)
+		return 0;
+
+	/* Calculate timeout */
+	struct timespec ts;
+	get_deadline(&ts, timeout);
+
+	/* Get queue lock */
+	pthread_mutex_lock(&(queue->mutex));
+	while (queue->items == queue->size) {
+		queue->waiting_full++;
+		const int ret = pthread_cond_timedwait(&(queue->cond_full), &(queue->mutex), &ts);
+		queue->waiting_full--;
+		if ((ret != 0) && (queue->items == queue->size)) {
+			pthread_mutex_unlock(&(queue->mutex));
+			return 0;
+		}
+	}
+
+	/* Copy objects from input buffer, as many as there is room for */
+	int added = queue->size - queue->items;
+	if (added > count)
+		added = count;
+	for (int i = 0; i < added; i++) {
+		memcpy(queue->buffer+(queue->in * queue->item_size), ((const uint8_t *) values) + (i * queue->item_size), queue->item_size);
+		queue->in = (queue->in + 1) % queue->size;
+	}
+	queue->items += added;
+	const int waiting = queue->waiting_empty;
+	pthread_mutex_unlock(&(queue->mutex));
+
+	/* Nofify blocked threads */
+	notify_waiters(&(queue->cond_empty), waiting, added);
+
+	return added;
+
+}
+
+int pthread_queue_dequeue_bulk(pthread_queue_t * queue, void * buf, int count, uint32_t timeout) {
+
+	if (count <= 0)
+		return 0;
+
+	/* Calculate timeout */
+	struct timespec ts;
+	get_deadline(&ts, timeout);
+
+	/* Get queue lock */
+	pthread_mutex_lock(&(queue->mutex));
+	while (queue->items == 0) {
+		queue->waiting_empty++;
+		const int ret = pthread_cond_timedwait(&(queue->cond_empty), &(queue->mutex), &ts);
+		queue->waiting_empty--;
+		if ((ret != 0) && (queue->items == 0)) {
+			pthread_mutex_unlock(&(queue->mutex));
+			return 0;
+		}
+	}
+
+	/* Copy objects to output buffer, as many as available */
+	int removed = (queue->items < count) ? queue->items : count;
+	for (int i = 0; i < removed; i++) {
+		memcpy(((uint8_t *) buf) + (i * queue->item_size), queue->buffer+(queue->out * queue->item_size), queue->item_size);
+		queue->out = (queue->out + 1) % queue->size;
+	}
+	queue->items -= removed;
+	const int waiting = queue->waiting_full;
+	pthread_mutex_unlock(&(queue->mutex));
+
+	/* Nofify blocked threads */
+	notify_waiters(&(queue->cond_full), waiting, removed);
+
+	return removed;
+
+}
+
+int pthread_queue_peek_range(pthread_queue_t * queue, void * buf, int first, int count) {
+
+	if ((first < 0) || (count <= 0))
+		return 0;
+
+	/* Get queue lock */
+	pthread_mutex_lock(&(queue->mutex));
+
+	/* Copy objects to output buffer, as many as available */
+	int copied = (first < queue->items) ? (queue->items - first) : 0;
+	if (copied > count)
+		copied = count;
+	for (int i = 0; i < copied; i++) {
+		const int index = (queue->out + first + i) % queue->size;
+		memcpy(((uint8_t *) buf) + (i * queue->item_size), queue->buffer+(index * queue->item_size), queue->item_size);
+	}
+	pthread_mutex_unlock(&(queue->mutex));
+
+	return copied;
+
+}
+
 int pthread_queue_items(pthread_queue_t * queue) {
 
 	pthread_mutex_lock(&(queue->mutex));
@@ -18,10 +18,24 @@ License along with this library; if not, write to the Free Software
 Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
 */
 
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#if defined(__linux__)
+#include <sys/syscall.h>
+#endif
 
 #include <csp/arch/csp_malloc.h>
 
+/* Internal option, memory is allocated with mmap() */
+#define CSP_MALLOC_MMAP		0x80
+
+#if defined(__linux__) && defined(SYS_mbind)
+#define CSP_MALLOC_MPOL_BIND	2	// MPOL_BIND from <numaif.h>, avoids dependency on libnuma
+#endif
+
 void * csp_malloc(size_t size) {
 	return malloc(size);
 }
@@ -34,3 +48,100 @@ void csp_free(void *ptr) {
 	free(ptr);
 }
 
+/* Size of huge pages, 0 if not known */
+static size_t csp_malloc_hugepage_size(void) {
+
+#if defined(MAP_HUGETLB)
+	size_t size = 0;
+	FILE * fp = fopen("/proc/meminfo", "r");
+	if (fp) {
+		char line[100];
+		while (fgets(line, sizeof(line), fp)) {
+			unsigned long kb;
+			if (sscanf(line, "Hugepagesize: %lu kB", &kb) == 1) {
+				size = kb * 1024;
+				break;
+			}
+		}
+		fclose(fp);
+	}
+	return size;
+#else
+	return 0;
+#endif
+}
+
+/* Round size up to multiple of page size */
+static size_t csp_malloc_pool_size(size_t size, uint32_t flags) {
+
+	size_t page = (size_t) sysconf(_SC_PAGESIZE);
+	if (flags & CSP_MALLOC_HUGEPAGE) {
+		page = csp_malloc_hugepage_size();
+	}
+	return ((size + page - 1) / page) * page;
+}
+
+void * csp_malloc_pool(size_t size, uint32_t * flags, int numa_node) {
+
+	*flags &= ~CSP_MALLOC_NUMA_BIND;
+	if ((*flags == 0) && (numa_node < 0)) {
+		return csp_malloc(size);
+	}
+
+	void * ptr = MAP_FAILED;
+
+#if defined(MAP_HUGETLB)
+	if ((*flags & CSP_MALLOC_HUGEPAGE) && csp_malloc_hugepage_size()) {
+		ptr = mmap(NULL, csp_malloc_pool_size(size, CSP_MALLOC_HUGEPAGE), PROT_READ | PROT_WRITE,
+				   MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+	}
+#endif
+	if (ptr == MAP_FAILED) {
+		// no (free) huge pages, fall back to normal pages
+		*flags &= ~CSP_MALLOC_HUGEPAGE;
+		ptr = mmap(NULL, csp_malloc_pool_size(size, 0), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (ptr == MAP_FAILED) {
+			return NULL;
+		}
+	}
+
+#if defined(CSP_MALLOC_MPOL_BIND)
+	// bind before the pages are faulted in
+	// nodes above the mask width are not supported, left unbound
+	if ((numa_node >= 0) && (numa_node < (int) (8 * sizeof(unsigned long)))) {
+		const unsigned long nodemask = 1UL << numa_node;
+		if (syscall(SYS_mbind, ptr, csp_malloc_pool_size(size, *flags), CSP_MALLOC_MPOL_BIND, &nodemask, 8 * sizeof(nodemask) + 1, 0) == 0) {
+			*flags |= CSP_MALLOC_NUMA_BIND;
+		}
+	}
+#endif
+
+	if ((*flags & CSP_MALLOC_LOCK) && (mlock(ptr, size) != 0)) {
+		// e.g. RLIMIT_MEMLOCK too low
+		*flags &= ~CSP_MALLOC_LOCK;
+	}
+
+	if (*flags & (CSP_MALLOC_PREFAULT | CSP_MALLOC_LOCK)) {
+		// write, so pages are not only mapped to the shared zero page
+		memset(ptr, 0, size);
+		*flags |= CSP_MALLOC_PREFAULT;
+	}
+
+	// mmap'ed, even if no options were applied
+	*flags |= CSP_MALLOC_MMAP;
+
+	return ptr;
+}
+
+void csp_free_pool(void * ptr, size_t size, uint32_t flags) {
+
+	if (ptr == NULL) {
+		return;
+	}
+
+	if (flags & CSP_MALLOC_MMAP) {
+		munmap(ptr, csp_malloc_pool_size(size, flags));
+	} else {
+		csp_free(ptr);
+	}
+}
@@ -19,20 +19,35 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
 */
 
 #include <stdint.h>
+#include <stddef.h>
 
 #include <csp/arch/csp_queue.h>
+
+/* Lock-free queue on Linux, unless the pthread queue is requested (or not Linux, e.g. MacOSX) */
+#if defined(__linux__) && !defined(CSP_POSIX_QUEUE_PTHREAD)
+
+#include <csp/arch/posix/ring_queue.h>
+
+#define QUEUE(op)	ring_queue_##op
+
+#else
+
 #include <csp/arch/posix/pthread_queue.h>
 
+#define QUEUE(op)	pthread_queue_##op
+
+#endif
+
 csp_queue_handle_t csp_queue_create(int length, size_t item_size) {
-	return pthread_queue_create(length, item_size);
+	return QUEUE(create)(length, item_size);
 }
 
 void csp_queue_remove(csp_queue_handle_t queue) {
-	return pthread_queue_delete(queue);
+	return QUEUE(delete)(queue);
 }
 
 int csp_queue_enqueue(csp_queue_handle_t handle, const void *value, uint32_t timeout) {
-	return pthread_queue_enqueue(handle, value, timeout);
+	return QUEUE(enqueue)(handle, value, timeout);
 }
 
 int csp_queue_enqueue_isr(csp_queue_handle_t handle, const void * value, CSP_BASE_TYPE * task_woken) {
@@ -43,7 +58,7 @@ int csp_queue_enqueue_isr(csp_queue_handle_t handle, const void * value, CSP_BAS
 }
 
 int csp_queue_dequeue(csp_queue_handle_t handle, void *buf, uint32_t timeout) {
-	return pthread_queue_dequeue(handle, buf, timeout);
+	return QUEUE(dequeue)(handle, buf, timeout);
 }
 
 int csp_queue_dequeue_isr(csp_queue_handle_t handle, void *buf, CSP_BASE_TYPE * task_woken) {
@@ -53,10 +68,22 @@ int csp_queue_dequeue_isr(csp_queue_handle_t handle, void *buf, CSP_BASE_TYPE *
 	return csp_queue_dequeue(handle, buf, 0);
 }
 
+int csp_queue_enqueue_bulk(csp_queue_handle_t handle, const void * values, int count, uint32_t timeout) {
+	return QUEUE(enqueue_bulk)(handle, values, count, timeout);
+}
+
+int csp_queue_dequeue_bulk(csp_queue_handle_t handle, void * buf, int count, uint32_t timeout) {
+	return QUEUE(dequeue_bulk)(handle, buf, count, timeout);
+}
+
+int csp_queue_peek_range(csp_queue_handle_t handle, void * buf, int first, int count) {
+	return QUEUE(peek_range)(handle, buf, first, count);
+}
+
 int csp_queue_size(csp_queue_handle_t handle) {
-	return pthread_queue_items(handle);
+	return QUEUE(items)(handle);
 }
 
 int csp_queue_size_isr(csp_queue_handle_t handle) {
-	return pthread_queue_items(handle);
+	return QUEUE(items)(handle);
 }
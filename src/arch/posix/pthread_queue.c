@@ -68,6 +68,27 @@ static inline int init_cond_clock_monotonic(pthread_cond_t * cond) {
 	return ret;
 }
 
+/* Wake as many waiters as there are new slots/items - only signal if someone is actually waiting */
+static inline void notify_waiters(pthread_cond_t * cond, int waiting, int count) {
+
+	if ((waiting == 0) || (count <= 0)) {
+		return;
+	}
+
+	if (count >= waiting) {
+		if (waiting == 1) {
+			pthread_cond_signal(cond);
+		} else {
+			pthread_cond_broadcast(cond);
+		}
+		return;
+	}
+
+	while (count--) {
+		pthread_cond_signal(cond);
+	}
+}
+
 pthread_queue_t * pthread_queue_create(int length, size_t item_size) {
 
 	pthread_queue_t * q = csp_malloc(sizeof(pthread_queue_t));
@@ -82,6 +103,8 @@ pthread_queue_t * pthread_queue_create(int length, size_t item_size) {
 			q->items = 0;
 			q->in = 0;
 			q->out = 0;
+			q->waiting_full = 0;
+			q->waiting_empty = 0;
 
 			if (pthread_mutex_init(&(q->mutex), NULL) ||
 				init_cond_clock_monotonic(&(q->cond_full)) ||
@@ -116,13 +139,16 @@ static inline int wait_slot_available(pthread_queue_t * queue, struct timespec *
 	int ret;
 
 	while (queue->items == queue->size) {
+		queue->waiting_full++;
 		if (ts != NULL) {
 			ret = pthread_cond_timedwait(&(queue->cond_full), &(queue->mutex), ts);
 		} else {
 			ret = pthread_cond_wait(&(queue->cond_full), &(queue->mutex));
 		}
+		queue->waiting_full--;
 
-		if (ret != 0 && errno != EINTR) {
+		/* A signal may race with the timeout, so only fail if the condition still holds */
+		if (ret != 0 && errno != EINTR && queue->items == queue->size) {
 			return PTHREAD_QUEUE_FULL; //Timeout
 		}
 	}
@@ -158,11 +184,13 @@ int pthread_queue_enqueue(pthread_queue_t * queue, const void * value, uint32_t
 		queue->in = (queue->in + 1) % queue->size;
 	}
 
+	const int waiting = queue->waiting_empty;
+
 	pthread_mutex_unlock(&(queue->mutex));
 
 	if (ret == PTHREAD_QUEUE_OK) {
 		/* Nofify blocked threads */
-		pthread_cond_broadcast(&(queue->cond_empty));
+		notify_waiters(&(queue->cond_empty), waiting, 1);
 	}
 
 	return ret;
@@ -173,13 +201,16 @@ static inline int wait_item_available(pthread_queue_t * queue, struct timespec *
 	int ret;
 
 	while (queue->items == 0) {
+		queue->waiting_empty++;
 		if (ts != NULL) {
 			ret = pthread_cond_timedwait(&(queue->cond_empty), &(queue->mutex), ts);
 		} else {
 			ret = pthread_cond_wait(&(queue->cond_empty), &(queue->mutex));
 		}
+		queue->waiting_empty--;
 
-		if (ret != 0 && errno != EINTR) {
+		/* A signal may race with the timeout, so only fail if the condition still holds */
+		if (ret != 0 && errno != EINTR && queue->items == 0) {
 			return PTHREAD_QUEUE_EMPTY; //Timeout
 		}
 	}
@@ -214,16 +245,127 @@ int pthread_queue_dequeue(pthread_queue_t * queue, void * buf, uint32_t timeout)
 		queue->out = (queue->out + 1) % queue->size;
 	}
 
+	const int waiting = queue->waiting_full;
+
 	pthread_mutex_unlock(&(queue->mutex));
 
 	if (ret == PTHREAD_QUEUE_OK) {
 		/* Nofify blocked threads */
-		pthread_cond_broadcast(&(queue->cond_full));
+		notify_waiters(&(queue->cond_full), waiting, 1);
 	}
 
 	return ret;
 }
 
+int pthread_queue_enqueue_bulk(pthread_queue_t * queue, const void * values, int count, uint32_t timeout) {
+
+	struct timespec ts;
+	struct timespec *pts = NULL;
+	int added = 0;
+
+	if (count <= 0) {
+		return 0;
+	}
+
+	/* Calculate timeout */
+	if (timeout != CSP_MAX_TIMEOUT) {
+		if (get_deadline(&ts, timeout) != 0) {
+			return 0;
+		}
+		pts = &ts;
+	}
+
+	/* Get queue lock */
+	pthread_mutex_lock(&(queue->mutex));
+
+	if (wait_slot_available(queue, pts) == PTHREAD_QUEUE_OK) {
+		/* Copy objects from input buffer, as many as there is room for */
+		added = queue->size - queue->items;
+		if (added > count) {
+			added = count;
+		}
+		for (int i = 0; i < added; i++) {
+			memcpy(queue->buffer+(queue->in * queue->item_size), ((const uint8_t *) values) + (i * queue->item_size), queue->item_size);
+			queue->in = (queue->in + 1) % queue->size;
+		}
+		queue->items += added;
+	}
+
+	const int waiting = queue->waiting_empty;
+
+	pthread_mutex_unlock(&(queue->mutex));
+
+	/* Nofify blocked threads */
+	notify_waiters(&(queue->cond_empty), waiting, added);
+
+	return added;
+}
+
+int pthread_queue_dequeue_bulk(pthread_queue_t * queue, void * buf, int count, uint32_t timeout) {
+
+	struct timespec ts;
+	struct timespec *pts = NULL;
+	int removed = 0;
+
+	if (count <= 0) {
+		return 0;
+	}
+
+	/* Calculate timeout */
+	if (timeout != CSP_MAX_TIMEOUT) {
+		if (get_deadline(&ts, timeout) != 0) {
+			return 0;
+		}
+		pts = &ts;
+	}
+
+	/* Get queue lock */
+	pthread_mutex_lock(&(queue->mutex));
+
+	if (wait_item_available(queue, pts) == PTHREAD_QUEUE_OK) {
+		/* Copy objects to output buffer, as many as available */
+		removed = (queue->items < count) ? queue->items : count;
+		for (int i = 0; i < removed; i++) {
+			memcpy(((uint8_t *) buf) + (i * queue->item_size), queue->buffer+(queue->out * queue->item_size), queue->item_size);
+			queue->out = (queue->out + 1) % queue->size;
+		}
+		queue->items -= removed;
+	}
+
+	const int waiting = queue->waiting_full;
+
+	pthread_mutex_unlock(&(queue->mutex));
+
+	/* Nofify blocked threads */
+	notify_waiters(&(queue->cond_full), waiting, removed);
+
+	return removed;
+}
+
+int pthread_queue_peek_range(pthread_queue_t * queue, void * buf, int first, int count) {
+
+	int copied = 0;
+
+	if ((first < 0) || (count <= 0)) {
+		return 0;
+	}
+
+	/* Get queue lock */
+	pthread_mutex_lock(&(queue->mutex));
+
+	if (first < queue->items) {
+		copied = ((queue->items - first) < count) ? (queue->items - first) : count;
+		for (int i = 0; i < copied; i++) {
+			const int index = (queue->out + first + i) % queue->size;
+			memcpy(((uint8_t *) buf) + (i * queue->item_size), queue->buffer+(index * queue->item_size), queue->item_size);
+		}
+	}
+
+	pthread_mutex_unlock(&(queue->mutex));
+
+	return copied;
+}
+
 int pthread_queue_items(pthread_queue_t * queue) {
 
 	pthread_mutex_lock(&(queue->mutex));
@@ -0,0 +1,347 @@
+/*
+Cubesat Space Protocol - A small network-layer protocol designed for Cubesats
+Copyright (C) 2012 Gomspace ApS (http://www.gomspace.com)
+Copyright (C) 2012 AAUSAT3 Project (http://aausat3.space.aau.dk)
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#if defined(__linux__)
+
+#include <sched.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include <csp/arch/csp_malloc.h>
+#include <csp/arch/posix/ring_queue.h>
+
+/* Avoid false sharing between producers and consumers */
+#define RING_QUEUE_CACHE_LINE	64
+
+/** Queue slot, followed by the element */
+typedef struct {
+	//! Sequence, equal to the enqueue position when free, and the position + 1 when filled.
+	uint64_t seq;
+} ring_cell_t;
+
+/** Blocked threads on one side of the queue (full or empty) */
+typedef struct {
+	//! Futex word, incremented on every wake up.
+	uint32_t futex;
+	//! Number of threads waiting.
+	uint32_t waiters;
+} ring_wait_t;
+
+struct ring_queue_s {
+	//! Next position to enqueue (producers).
+	uint64_t enqueue_pos;
+	//! Wait because queue is empty (extract).
+	ring_wait_t wait_empty;
+	uint8_t pad1[RING_QUEUE_CACHE_LINE - sizeof(uint64_t) - sizeof(ring_wait_t)];
+	//! Next position to dequeue (consumers).
+	uint64_t dequeue_pos;
+	//! Wait because queue is full (insert).
+	ring_wait_t wait_full;
+	uint8_t pad2[RING_QUEUE_CACHE_LINE - sizeof(uint64_t) - sizeof(ring_wait_t)];
+	//! Number of slots.
+	uint32_t size;
+	//! Item/element size.
+	uint32_t item_size;
+	//! Size of slot, including element.
+	uint32_t cell_size;
+	//! Slots.
+	uint8_t * cells;
+};
+
+typedef int (*ring_try_t)(ring_queue_t * queue, void * item);
+
+static inline ring_cell_t * ring_cell(ring_queue_t * queue, uint64_t pos) {
+	return (ring_cell_t *) &queue->cells[(pos % queue->size) * queue->cell_size];
+}
+
+static int ring_try_enqueue(ring_queue_t * queue, void * value) {
+
+	uint64_t pos = __atomic_load_n(&queue->enqueue_pos, __ATOMIC_RELAXED);
+
+	for (;;) {
+		ring_cell_t * cell = ring_cell(queue, pos);
+		const int64_t diff = (int64_t) (__atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE) - pos);
+
+		if (diff == 0) {
+			/* Slot is free, claim it (on failure, pos is updated) */
+			if (__atomic_compare_exchange_n(&queue->enqueue_pos, &pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+				memcpy(cell + 1, value, queue->item_size);
+				__atomic_store_n(&cell->seq, pos + 1, __ATOMIC_RELEASE);
+				return 1;
+			}
+		} else if (diff < 0) {
+			/* Slot not dequeued yet - queue is full, unless a consumer has claimed the slot and not released it yet */
+			if ((int64_t) (pos - __atomic_load_n(&queue->dequeue_pos, __ATOMIC_ACQUIRE)) >= (int64_t) queue->size) {
+				return 0;
+			}
+			sched_yield();
+			pos = __atomic_load_n(&queue->enqueue_pos, __ATOMIC_RELAXED);
+		} else {
+			/* Another producer claimed the slot */
+			pos = __atomic_load_n(&queue->enqueue_pos, __ATOMIC_RELAXED);
+		}
+	}
+}
+
+static int ring_try_dequeue(ring_queue_t * queue, void * buf) {
+
+	uint64_t pos = __atomic_load_n(&queue->dequeue_pos, __ATOMIC_RELAXED);
+
+	for (;;) {
+		ring_cell_t * cell = ring_cell(queue, pos);
+		const int64_t diff = (int64_t) (__atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE) - (pos + 1));
+
+		if (diff == 0) {
+			/* Slot is filled, claim it (on failure, pos is updated) */
+			if (__atomic_compare_exchange_n(&queue->dequeue_pos, &pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+				memcpy(buf, cell + 1, queue->item_size);
+				/* Free slot for the next lap */
+				__atomic_store_n(&cell->seq, pos + queue->size, __ATOMIC_RELEASE);
+				return 1;
+			}
+		} else if (diff < 0) {
+			/* Slot not enqueued yet - queue is empty, unless a producer has claimed the slot and not filled it yet */
+			if ((int64_t) (__atomic_load_n(&queue->enqueue_pos, __ATOMIC_ACQUIRE) - pos) <= 0) {
+				return 0;
+			}
+			sched_yield();
+			pos = __atomic_load_n(&queue->dequeue_pos, __ATOMIC_RELAXED);
+		} else {
+			/* Another consumer claimed the slot */
+			pos = __atomic_load_n(&queue->dequeue_pos, __ATOMIC_RELAXED);
+		}
+	}
+}
+
+static inline long ring_futex(uint32_t * uaddr, int op, uint32_t val, const struct timespec * timeout) {
+	return syscall(SYS_futex, uaddr, op, val, timeout, NULL, 0);
+}
+
+/* Wake up to 'count' threads, if any are waiting */
+static void ring_wake(ring_wait_t * wait, int count) {
+
+	/* Pairs with the waiter incrementing 'waiters' before checking the queue again */
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+	if (__atomic_load_n(&wait->waiters, __ATOMIC_RELAXED) == 0) {
+		return;
+	}
+
+	__atomic_add_fetch(&wait->futex, 1, __ATOMIC_SEQ_CST);
+	ring_futex(&wait->futex, FUTEX_WAKE_PRIVATE, count, NULL);
+}
+
+/* Perform operation, waiting up to 'timeout' for room/element */
+static int ring_blocking(ring_queue_t * queue, ring_try_t try_op, ring_wait_t * wait, void * item, uint32_t timeout) {
+
+	if (try_op(queue, item)) {
+		return 1;
+	}
+
+	if (timeout == 0) {
+		return 0;
+	}
+
+	struct timespec deadline;
+	if (timeout != CSP_MAX_TIMEOUT) {
+		clock_gettime(CLOCK_MONOTONIC, &deadline);
+		deadline.tv_sec += timeout / 1000;
+		deadline.tv_nsec += (timeout % 1000) * 1000000;
+		if (deadline.tv_nsec >= 1000000000) {
+			deadline.tv_sec++;
+			deadline.tv_nsec -= 1000000000;
+		}
+	}
+
+	int ret = 0;
+	__atomic_add_fetch(&wait->waiters, 1, __ATOMIC_SEQ_CST);
+
+	for (;;) {
+		const uint32_t futex = __atomic_load_n(&wait->futex, __ATOMIC_SEQ_CST);
+
+		if (try_op(queue, item)) {
+			ret = 1;
+			break;
+		}
+
+		struct timespec remaining;
+		struct timespec * premaining = NULL;
+		if (timeout != CSP_MAX_TIMEOUT) {
+			struct timespec now;
+			clock_gettime(CLOCK_MONOTONIC, &now);
+			remaining.tv_sec = deadline.tv_sec - now.tv_sec;
+			remaining.tv_nsec = deadline.tv_nsec - now.tv_nsec;
+			if (remaining.tv_nsec < 0) {
+				remaining.tv_sec--;
+				remaining.tv_nsec += 1000000000;
+			}
+			if (remaining.tv_sec < 0) {
+				break; // timeout
+			}
+			premaining = &remaining;
+		}
+
+		/* Returns immediately, if the futex was changed (woken) after it was read */
+		ring_futex(&wait->futex, FUTEX_WAIT_PRIVATE, futex, premaining);
+	}
+
+	__atomic_sub_fetch(&wait->waiters, 1, __ATOMIC_SEQ_CST);
+
+	return ret;
+}
+
+ring_queue_t * ring_queue_create(int length, size_t item_size) {
+
+	if ((length <= 0) || (item_size == 0)) {
+		return NULL;
+	}
+
+	ring_queue_t * q = csp_calloc(1, sizeof(*q));
+	if (q == NULL) {
+		return NULL;
+	}
+
+	q->size = length;
+	q->item_size = item_size;
+	q->cell_size = sizeof(ring_cell_t) * (1 + ((item_size + sizeof(ring_cell_t) - 1) / sizeof(ring_cell_t)));
+	q->cells = csp_malloc(q->size * q->cell_size);
+	if (q->cells == NULL) {
+		csp_free(q);
+		return NULL;
+	}
+
+	for (uint32_t i = 0; i < q->size; i++) {
+		ring_cell(q, i)->seq = i;
+	}
+
+	return q;
+}
+
+void ring_queue_delete(ring_queue_t * q) {
+
+	if (q == NULL) {
+		return;
+	}
+
+	csp_free(q->cells);
+	csp_free(q);
+}
+
+int ring_queue_enqueue(ring_queue_t * queue, const void * value, uint32_t timeout) {
+
+	if (!ring_blocking(queue, ring_try_enqueue, &queue->wait_full, (void *) value, timeout)) {
+		return CSP_QUEUE_ERROR;
+	}
+
+	ring_wake(&queue->wait_empty, 1);
+
+	return CSP_QUEUE_OK;
+}
+
+int ring_queue_dequeue(ring_queue_t * queue, void * buf, uint32_t timeout) {
+
+	if (!ring_blocking(queue, ring_try_dequeue, &queue->wait_empty, buf, timeout)) {
+		return CSP_QUEUE_ERROR;
+	}
+
+	ring_wake(&queue->wait_full, 1);
+
+	return CSP_QUEUE_OK;
+}
+
+int ring_queue_enqueue_bulk(ring_queue_t * queue, const void * values, int count, uint32_t timeout) {
+
+	if ((count <= 0) || !ring_blocking(queue, ring_try_enqueue, &queue->wait_full, (void *) values, timeout)) {
+		return 0;
+	}
+
+	int added = 1;
+	while ((added < count) && ring_try_enqueue(queue, (void *) (((const uint8_t *) values) + (added * queue->item_size)))) {
+		added++;
+	}
+
+	ring_wake(&queue->wait_empty, added);
+
+	return added;
+}
+
+int ring_queue_dequeue_bulk(ring_queue_t * queue, void * buf, int count, uint32_t timeout) {
+
+	if ((count <= 0) || !ring_blocking(queue, ring_try_dequeue, &queue->wait_empty, buf, timeout)) {
+		return 0;
+	}
+
+	int removed = 1;
+	while ((removed < count) && ring_try_dequeue(queue, ((uint8_t *) buf) + (removed * queue->item_size))) {
+		removed++;
+	}
+
+	ring_wake(&queue->wait_full, removed);
+
+	return removed;
+}
+
+int ring_queue_peek_range(ring_queue_t * queue, void * buf, int first, int count) {
+
+	if ((first < 0) || (count <= 0)) {
+		return 0;
+	}
+
+	const uint64_t out = __atomic_load_n(&queue->dequeue_pos, __ATOMIC_ACQUIRE);
+
+	int copied;
+	for (copied = 0; copied < count; copied++) {
+		const uint64_t pos = out + first + copied;
+		ring_cell_t * cell = ring_cell(queue, pos);
+
+		/* Slot must be filled for this lap before and after the copy, otherwise a consumer took it */
+		if (__atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE) != (pos + 1)) {
+			break;
+		}
+		memcpy(((uint8_t *) buf) + (copied * queue->item_size), cell + 1, queue->item_size);
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (__atomic_load_n(&cell->seq, __ATOMIC_RELAXED) != (pos + 1)) {
+			break;
+		}
+	}
+
+	return copied;
+}
+
+int ring_queue_items(ring_queue_t * queue) {
+
+	const uint64_t out = __atomic_load_n(&queue->dequeue_pos, __ATOMIC_ACQUIRE);
+	const uint64_t in = __atomic_load_n(&queue->enqueue_pos, __ATOMIC_ACQUIRE);
+
+	/* Positions are read at different times, keep the result in range */
+	if (in <= out) {
+		return 0;
+	}
+	if ((in - out) > queue->size) {
+		return queue->size;
+	}
+	return (int) (in - out);
+}
+
+#endif // __linux__
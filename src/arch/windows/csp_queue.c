@@ -50,6 +50,18 @@ int csp_queue_dequeue_isr(csp_queue_handle_t handle, void * buf, CSP_BASE_TYPE *
 	return windows_queue_dequeue(handle, buf, 0);
 }
 
+int csp_queue_enqueue_bulk(csp_queue_handle_t handle, const void * values, int count, uint32_t timeout) {
+	return windows_queue_enqueue_bulk(handle, values, count, timeout);
+}
+
+int csp_queue_dequeue_bulk(csp_queue_handle_t handle, void * buf, int count, uint32_t timeout) {
+	return windows_queue_dequeue_bulk(handle, buf, count, timeout);
+}
+
+int csp_queue_peek_range(csp_queue_handle_t handle, void * buf, int first, int count) {
+	return windows_queue_peek_range(handle, buf, first, count);
+}
+
 int csp_queue_size(csp_queue_handle_t handle) {
 	return windows_queue_items(handle);
 }
@@ -116,6 +116,76 @@ int windows_queue_dequeue(windows_queue_t * queue, void * buf, int timeout) {
 	return WINDOWS_QUEUE_OK;
 }
 
+int windows_queue_enqueue_bulk(windows_queue_t * queue, const void * values, int count, int timeout) {
+
+	int added;
+	if (count <= 0)
+		return 0;
+	EnterCriticalSection(&(queue->mutex));
+	while(queueFull(queue)) {
+		int ret = SleepConditionVariableCS(&(queue->cond_full), &(queue->mutex), timeout);
+		if( !ret ) {
+			LeaveCriticalSection(&(queue->mutex));
+			return 0;
+		}
+	}
+	added = queue->size - queue->items;
+	if (added > count)
+		added = count;
+	for (int i = 0; i < added; i++) {
+		int offset = ((queue->head_idx+queue->items) % queue->size) * queue->item_size;
+		memcpy((unsigned char*)queue->buffer + offset, (const unsigned char*)values + (i * queue->item_size), queue->item_size);
+		queue->items++;
+	}
+
+	LeaveCriticalSection(&(queue->mutex));
+	WakeAllConditionVariable(&(queue->cond_empty));
+	return added;
+}
+
+int windows_queue_dequeue_bulk(windows_queue_t * queue, void * buf, int count, int timeout) {
+
+	int removed;
+	if (count <= 0)
+		return 0;
+	EnterCriticalSection(&(queue->mutex));
+	while(queueEmpty(queue)) {
+		int ret = SleepConditionVariableCS(&(queue->cond_empty), &(queue->mutex), timeout);
+		if( !ret ) {
+			LeaveCriticalSection(&(queue->mutex));
+			return 0;
+		}
+	}
+	removed = (queue->items < count) ? queue->items : count;
+	for (int i = 0; i < removed; i++) {
+		memcpy((unsigned char*)buf + (i * queue->item_size), (unsigned char*)queue->buffer+(queue->head_idx%queue->size*queue->item_size), queue->item_size);
+		queue->items--;
+		queue->head_idx = (queue->head_idx + 1) % queue->size;
+	}
+
+	LeaveCriticalSection(&(queue->mutex));
+	WakeAllConditionVariable(&(queue->cond_full));
+	return removed;
+}
+
+int windows_queue_peek_range(windows_queue_t * queue, void * buf, int first, int count) {
+
+	int copied;
+	if ((first < 0) || (count <= 0))
+		return 0;
+	EnterCriticalSection(&(queue->mutex));
+	copied = (first < queue->items) ? (queue->items - first) : 0;
+	if (copied > count)
+		copied = count;
+	for (int i = 0; i < copied; i++) {
+		int offset = ((queue->head_idx + first + i) % queue->size) * queue->item_size;
+		memcpy((unsigned char*)buf + (i * queue->item_size), (unsigned char*)queue->buffer + offset, queue->item_size);
+	}
+
+	LeaveCriticalSection(&(queue->mutex));
+	return copied;
+}
+
 int windows_queue_items(windows_queue_t * queue) {
 
 	int items;
@@ -126,7 +126,7 @@ int csp_xtea_encrypt_packet(csp_packet_t * packet) {
 	const uint32_t nonce = (uint32_t)rand();
 	const uint32_t nonce_n = csp_hton32(nonce);
 
-	if ((packet->length + sizeof(nonce_n)) > csp_buffer_data_size()) {
+	if (csp_packet_tailroom(packet) < sizeof(nonce_n)) {
 		return CSP_ERR_NOMEM;
 	}
 
@@ -138,8 +138,11 @@ int csp_xtea_encrypt_packet(csp_packet_t * packet) {
 		return CSP_ERR_XTEA;
 	}
 
-	memcpy(&packet->data[packet->length], &nonce_n, sizeof(nonce_n));
-	packet->length += sizeof(nonce_n);
+	void * tail = csp_packet_put(packet, sizeof(nonce_n));
+	if (tail == NULL) {
+		return CSP_ERR_NOMEM;
+	}
+	memcpy(tail, &nonce_n, sizeof(nonce_n));
 
 	return CSP_ERR_NONE;
 }
@@ -170,7 +173,7 @@ int csp_xtea_decrypt_packet(csp_packet_t * packet) {
 		return CSP_ERR_XTEA;
 	}
 
-	packet->length -= sizeof(nonce);
+	csp_packet_trim(packet, sizeof(nonce));
 
 	return CSP_ERR_NONE;
 }
@@ -0,0 +1,118 @@
+/*
+Cubesat Space Protocol - A small network-layer protocol designed for Cubesats
+Copyright (C) 2012 GomSpace ApS (http://www.gomspace.com)
+Copyright (C) 2012 AAUSAT3 Project (http://aausat3.space.aau.dk)
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "csp_aqm.h"
+
+#include "csp_init.h"
+
+/* Integer square root */
+static uint32_t csp_aqm_sqrt(uint32_t value) {
+
+	uint32_t root = 0;
+	uint32_t bit = 1UL << 30;
+
+	while (bit > value) {
+		bit >>= 2;
+	}
+
+	while (bit) {
+		if (value >= root + bit) {
+			value -= root + bit;
+			root = (root >> 1) + bit;
+		} else {
+			root >>= 1;
+		}
+		bit >>= 2;
+	}
+
+	return root;
+}
+
+/* Next drop time, the drop rate increases with the square root of drops (4 fractional bits for the root) */
+static inline uint32_t csp_aqm_control_law(uint32_t t, uint32_t count) {
+	if (count > (UINT32_MAX >> 8)) {
+		count = UINT32_MAX >> 8;
+	}
+	return t + (((uint32_t) csp_conf.aqm_interval << 4) / csp_aqm_sqrt(count << 8));
+}
+
+static inline bool csp_aqm_time_after_eq(uint32_t time, uint32_t cmp) {
+	return ((int32_t) (time - cmp) >= 0);
+}
+
+/* Sojourn time above target for at least an interval */
+static bool csp_aqm_ok_to_drop(csp_aqm_t * aqm, uint32_t sojourn, uint32_t now, unsigned int backlog) {
+
+	/* Below target, or queue holds no more than this packet */
+	if ((sojourn < csp_conf.aqm_target) || (backlog == 0)) {
+		aqm->above = false;
+		return false;
+	}
+
+	if (!aqm->above) {
+		aqm->above = true;
+		aqm->first_above_time = now + csp_conf.aqm_interval;
+		return false;
+	}
+
+	return csp_aqm_time_after_eq(now, aqm->first_above_time);
+}
+
+bool csp_aqm_dequeue(csp_aqm_t * aqm, uint32_t timestamp, uint32_t now, unsigned int backlog) {
+
+	const uint32_t sojourn = now - timestamp;
+	bool drop = false;
+
+	aqm->stats.sojourn = sojourn;
+	if (sojourn > aqm->stats.sojourn_max) {
+		aqm->stats.sojourn_max = sojourn;
+	}
+
+	const bool ok_to_drop = csp_aqm_ok_to_drop(aqm, sojourn, now, backlog);
+
+	if (aqm->dropping) {
+		if (!ok_to_drop) {
+			/* Sojourn time below target, leave dropping state */
+			aqm->dropping = false;
+		} else if (csp_aqm_time_after_eq(now, aqm->drop_next)) {
+			aqm->count++;
+			aqm->drop_next = csp_aqm_control_law(aqm->drop_next, aqm->count);
+			drop = true;
+		}
+	} else if (ok_to_drop) {
+		/* Enter dropping state, resume the previous drop rate if it was recently left */
+		aqm->dropping = true;
+		const uint32_t delta = aqm->count - aqm->lastcount;
+		if ((delta > 1) && ((now - aqm->drop_next) < (16 * (uint32_t) csp_conf.aqm_interval))) {
+			aqm->count = delta;
+		} else {
+			aqm->count = 1;
+		}
+		aqm->lastcount = aqm->count;
+		aqm->drop_next = csp_aqm_control_law(now, aqm->count);
+		drop = true;
+	}
+
+	if (drop) {
+		aqm->stats.aqm_drops++;
+	}
+
+	return drop;
+}
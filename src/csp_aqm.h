@@ -0,0 +1,72 @@
+/*
+Cubesat Space Protocol - A small network-layer protocol designed for Cubesats
+Copyright (C) 2012 GomSpace ApS (http://www.gomspace.com)
+Copyright (C) 2012 AAUSAT3 Project (http://aausat3.space.aau.dk)
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef _CSP_AQM_H_
+#define _CSP_AQM_H_
+
+/**
+ * Active queue management (CoDel, RFC 8289) for router and connection queues.
+ *
+ * Packets are timestamped when queued, and the time spent in the queue (sojourn time) is checked when dequeued.
+ * If the sojourn time stays above csp_conf_t.aqm_target for a csp_conf_t.aqm_interval, packets are dropped at
+ * an increasing rate until it falls below the target again.
+ */
+
+#include <stdbool.h>
+#include <csp/csp.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** AQM state and statistics for a queue, must be zero initialized */
+typedef struct {
+	bool dropping;			/* In dropping state */
+	bool above;			/* Sojourn time above target, since first_above_time - interval */
+	uint32_t first_above_time;	/* Time to enter dropping state, if the sojourn time stays above target */
+	uint32_t drop_next;		/* Time for next drop, when dropping */
+	uint32_t count;			/* Drops since entering dropping state */
+	uint32_t lastcount;		/* Drops in last dropping state */
+	csp_queue_stats_t stats;
+} csp_aqm_t;
+
+/**
+ * Check if AQM is enabled (csp_conf_t.aqm_target set)
+ * @return true if enabled
+ */
+static inline bool csp_aqm_enabled(void) {
+	return (csp_get_conf()->aqm_target > 0);
+}
+
+/**
+ * Check dequeued packet
+ * @param aqm queue AQM state
+ * @param timestamp time the packet was queued (csp_get_ms())
+ * @param now current time (csp_get_ms())
+ * @param backlog number of packets left in the queue
+ * @return true if the packet should be dropped
+ */
+bool csp_aqm_dequeue(csp_aqm_t * aqm, uint32_t timestamp, uint32_t now, unsigned int backlog);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _CSP_AQM_H_ */
@@ -46,7 +46,7 @@ static CSP_DEFINE_TASK(csp_bridge) {
 		/* Get next packet to route */
 		csp_qfifo_t input;
 
-		if (csp_qfifo_read(&input) != CSP_ERR_NONE) {
+		if (csp_qfifo_read(0, &input) != CSP_ERR_NONE) {
 			continue;
 		}
 
@@ -84,6 +84,12 @@ static CSP_DEFINE_TASK(csp_bridge) {
 
 int csp_bridge_start(unsigned int task_stack_size, unsigned int task_priority, csp_iface_t * if_a, csp_iface_t * if_b) {
 
+	/* The bridge task reads all packets, i.e. there must be a single router shard */
+	if (csp_qfifo_shards() != 1) {
+		csp_log_error("Bridge requires a single router worker");
+		return CSP_ERR_INVAL;
+	}
+
 	/* Set static references to A/B side of bridge */
 	bif_a.iface = if_a;
 	bif_b.iface = if_b;
@@ -34,17 +34,166 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
 #define CSP_BUFFER_ALIGN	(sizeof(int *))
 #endif
 
+/* Room for trailers appended after allocation (RDP header, HMAC, XTEA nonce, CRC32).
+   csp_buffer_get() prefers a size class that leaves this room, if one exists. */
+#define CSP_BUFFER_TRAILER_RESERVE \
+	(((CSP_USE_RDP) ? 5 : 0) + ((CSP_USE_HMAC) ? 4 : 0) + ((CSP_USE_XTEA) ? 4 : 0) + ((CSP_USE_CRC32) ? 4 : 0))
+
+/* Per-thread buffer cache (magazine) is only available where thread-specific data has a destructor */
+#define CSP_BUFFER_USE_CACHE (CSP_POSIX || CSP_MACOSX)
+
+#if (CSP_BUFFER_USE_CACHE)
+#include <pthread.h>
+#endif
+
 /** Internal buffer header */
 typedef struct csp_skbf_s {
-	unsigned int refcount;
+	unsigned int refcount; // accessed with atomic builtins, see csp_buffer_ref()
+	uint16_t pool; // index in csp_buffer_pools
+	uint16_t pushed; // bytes added in front of csp_packet_t.id, see csp_packet_push()
 	void * skbf_addr;
-	char skbf_data[]; // -> csp_packet_t
+	void * next; // next segment (csp_packet_t) in chain, see csp_packet_chain()
+	char skbf_data[]; // -> headroom, csp_packet_t, tailroom
 } csp_skbf_t;
 
-// Queue of free CSP buffers
-static csp_queue_handle_t csp_buffers;
-// Chunk of memory allocated for CSP buffers
-static char * csp_buffer_pool;
+/** Buffer pool, one per size class */
+typedef struct {
+	// Queue of free CSP buffers
+	csp_queue_handle_t queue;
+	// Memory for CSP buffers (part of csp_buffer_memory)
+	char * memory;
+	// Size of each buffer including csp_skbf_t, aligned
+	unsigned int skbfsize;
+	uint16_t data_size;
+	uint16_t buffers;
+} csp_buffer_pool_t;
+
+// Pools sorted by increasing data size
+static csp_buffer_pool_t csp_buffer_pools[CSP_BUFFER_CLASSES_MAX];
+static unsigned int csp_buffer_pool_count;
+
+// Chunk of memory allocated for all pools
+static char * csp_buffer_memory;
+static size_t csp_buffer_memory_size;
+static uint32_t csp_buffer_memory_flags;
+
+// Extra room in front of csp_packet_t (aligned) and after the data part, same for all pools
+static unsigned int csp_buffer_headroom;
+static unsigned int csp_buffer_tailroom;
+
+/* Room in front of csp_packet_t.id, usable by csp_packet_push() */
+#define CSP_BUFFER_HEAD_ROOM	(csp_buffer_headroom + offsetof(csp_packet_t, id))
+
+/* Return buffer header from packet */
+static inline csp_skbf_t * csp_buffer_skbf(const void * packet) {
+	return (void*)(((uint8_t*)(uintptr_t)packet) - csp_buffer_headroom - sizeof(csp_skbf_t));
+}
+
+/* Return packet from buffer header */
+static inline void * csp_buffer_packet(csp_skbf_t * buf) {
+	return &buf->skbf_data[csp_buffer_headroom];
+}
+
+#if (CSP_BUFFER_USE_CACHE)
+/** Per-thread cache of free buffers from one pool */
+typedef struct {
+	volatile unsigned int count; // read by csp_buffer_remaining() from other threads
+	csp_skbf_t ** skbf;
+} csp_buffer_magazine_t;
+
+/** Per-thread cache, one magazine per pool */
+typedef struct csp_buffer_cache_s {
+	struct csp_buffer_cache_s * next;
+	csp_buffer_magazine_t mag[CSP_BUFFER_CLASSES_MAX];
+	csp_skbf_t * skbf[]; // storage for all magazines
+} csp_buffer_cache_t;
+
+// Key for thread specific cache, only valid if csp_buffer_cache_enabled
+static pthread_key_t csp_buffer_cache_key;
+static int csp_buffer_cache_enabled;
+// List of all thread caches, protected by csp_buffer_cache_lock
+static csp_buffer_cache_t * csp_buffer_caches;
+static pthread_mutex_t csp_buffer_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Return cached buffers above 'keep' to the global pool */
+static void csp_buffer_cache_flush(csp_buffer_magazine_t * mag, csp_buffer_pool_t * pool, unsigned int keep) {
+
+	while (mag->count > keep) {
+		const int added = csp_queue_enqueue_bulk(pool->queue, &mag->skbf[keep], mag->count - keep, 0);
+		if (added <= 0) {
+			break;
+		}
+		// move buffers not returned (if any) down, so they stay in the cache
+		memmove(&mag->skbf[keep], &mag->skbf[keep + added], (mag->count - keep - added) * sizeof(mag->skbf[0]));
+		mag->count -= added;
+	}
+}
+
+/* Get up to half a cache of buffers from the global pool */
+static void csp_buffer_cache_refill(csp_buffer_magazine_t * mag, csp_buffer_pool_t * pool) {
+
+	const unsigned int fill = (csp_conf.buffer_cache_size + 1) / 2;
+
+	if (mag->count < fill) {
+		mag->count += csp_queue_dequeue_bulk(pool->queue, &mag->skbf[mag->count], fill - mag->count, 0);
+	}
+}
+
+/* Thread exit, return all cached buffers */
+static void csp_buffer_cache_destroy(void * arg) {
+
+	csp_buffer_cache_t * cache = arg;
+
+	pthread_mutex_lock(&csp_buffer_cache_lock);
+	for (unsigned int i = 0; i < csp_buffer_pool_count; i++) {
+		csp_buffer_cache_flush(&cache->mag[i], &csp_buffer_pools[i], 0);
+	}
+	for (csp_buffer_cache_t ** pcache = &csp_buffer_caches; *pcache; pcache = &(*pcache)->next) {
+		if (*pcache == cache) {
+			*pcache = cache->next;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&csp_buffer_cache_lock);
+
+	csp_free(cache);
+}
+
+/* Get cache for calling thread, created on first use */
+static csp_buffer_cache_t * csp_buffer_cache_get(void) {
+
+	if (!csp_buffer_cache_enabled) {
+		return NULL;
+	}
+
+	csp_buffer_cache_t * cache = pthread_getspecific(csp_buffer_cache_key);
+	if (cache) {
+		return cache;
+	}
+
+	const unsigned int size = csp_conf.buffer_cache_size;
+	cache = csp_calloc(1, sizeof(*cache) + (csp_buffer_pool_count * size * sizeof(cache->skbf[0])));
+	if (cache == NULL) {
+		return NULL;
+	}
+
+	for (unsigned int i = 0; i < csp_buffer_pool_count; i++) {
+		cache->mag[i].skbf = &cache->skbf[i * size];
+	}
+
+	if (pthread_setspecific(csp_buffer_cache_key, cache) != 0) {
+		csp_free(cache);
+		return NULL;
+	}
+
+	pthread_mutex_lock(&csp_buffer_cache_lock);
+	cache->next = csp_buffer_caches;
+	csp_buffer_caches = cache;
+	pthread_mutex_unlock(&csp_buffer_cache_lock);
+
+	return cache;
+}
+#endif // CSP_BUFFER_USE_CACHE
 
 // Ensure the csp_packet is correctly aligned (as it is not packed)
 CSP_STATIC_ASSERT(CSP_HEADER_LENGTH == sizeof(csp_id_t), csp_header_length);
@@ -54,56 +203,243 @@ CSP_STATIC_ASSERT(offsetof(csp_packet_t, id) == 12, csp_id_field_misaligned);
 CSP_STATIC_ASSERT(offsetof(csp_packet_t, data) == 16, data_field_misaligned);
 
 int csp_buffer_init(void) {
-	// TODO assert on csp_conf.buffers == 0
-	unsigned int i;
 
-	// calculate total size and ensure correct alignment (int *) for buffers
-	const unsigned int skbfsize = CSP_BUFFER_ALIGN *
-		((sizeof(csp_skbf_t) + csp_buffer_size() + (CSP_BUFFER_ALIGN - 1)) / CSP_BUFFER_ALIGN);
+	csp_buffer_class_t dfl_class = {.data_size = csp_conf.buffer_data_size, .buffers = csp_conf.buffers};
+	const csp_buffer_class_t * classes = &dfl_class;
+	unsigned int class_count = 1;
+
+	if (csp_conf.buffer_classes && csp_conf.buffer_class_count) {
+		classes = csp_conf.buffer_classes;
+		class_count = csp_conf.buffer_class_count;
+	}
+
+	if (class_count > CSP_BUFFER_CLASSES_MAX) {
+		csp_log_error("csp_buffer_init: Too many buffer classes %u > max %u",
+					  class_count, CSP_BUFFER_CLASSES_MAX);
+		return CSP_ERR_INVAL;
+	}
+
+	csp_conf.buffers = 0;
+	csp_conf.buffer_data_size = 0;
+
+	// keep csp_packet_t aligned
+	csp_buffer_headroom = CSP_BUFFER_ALIGN * ((csp_conf.buffer_headroom + (CSP_BUFFER_ALIGN - 1)) / CSP_BUFFER_ALIGN);
+	csp_buffer_tailroom = csp_conf.buffer_tailroom;
+
+	csp_buffer_memory_size = 0;
+
+	uint32_t total_buffers = 0;
+	for (unsigned int c = 0; c < class_count; c++) {
+
+		if (classes[c].buffers == 0) {
+			csp_log_error("csp_buffer_init: Buffer class %u has no buffers", c);
+			goto fail_inval;
+		}
+		total_buffers += classes[c].buffers;
+		if (total_buffers > UINT16_MAX) {
+			// csp_conf.buffers reports the total
+			csp_log_error("csp_buffer_init: Too many buffers in total %u > max %u",
+						  (unsigned int) total_buffers, UINT16_MAX);
+			goto fail_inval;
+		}
+		if ((c > 0) && (classes[c].data_size <= classes[c - 1].data_size)) {
+			csp_log_error("csp_buffer_init: Buffer classes must have increasing data size");
+			goto fail_inval;
+		}
+
+		csp_buffer_pool_t * pool = &csp_buffer_pools[c];
+		csp_buffer_pool_count = c + 1;
+
+		pool->data_size = classes[c].data_size;
+		pool->buffers = classes[c].buffers;
+
+		// calculate total size and ensure correct alignment (int *) for buffers
+		pool->skbfsize = CSP_BUFFER_ALIGN *
+			((sizeof(csp_skbf_t) + csp_buffer_headroom + pool->data_size + CSP_BUFFER_PACKET_OVERHEAD + csp_buffer_tailroom + (CSP_BUFFER_ALIGN - 1)) / CSP_BUFFER_ALIGN);
+
+		csp_buffer_memory_size += pool->buffers * pool->skbfsize;
+	}
 
-	csp_buffer_pool = csp_malloc(csp_conf.buffers * skbfsize);
+	// all pools in one chunk, so huge pages are shared between the pools
+	csp_buffer_memory_flags = csp_conf.buffer_mem_flags;
+	csp_buffer_memory = csp_malloc_pool(csp_buffer_memory_size, &csp_buffer_memory_flags, csp_conf.buffer_numa_node);
 
-	if (csp_buffer_pool == NULL)
+	if (csp_buffer_memory == NULL)
 		goto fail_malloc;
 
-	csp_buffers = csp_queue_create(csp_conf.buffers, sizeof(void *));
+	if (csp_conf.buffer_mem_flags & ~csp_buffer_memory_flags) {
+		csp_log_warn("csp_buffer_init: Buffer memory options 0x%02x requested, 0x%02x applied",
+					 csp_conf.buffer_mem_flags, (unsigned int) (csp_buffer_memory_flags & csp_conf.buffer_mem_flags));
+	}
+	if ((csp_conf.buffer_numa_node >= 0) && !(csp_buffer_memory_flags & CSP_MALLOC_NUMA_BIND)) {
+		csp_log_warn("csp_buffer_init: Buffer memory not bound to NUMA node %d", csp_conf.buffer_numa_node);
+	}
+
+	for (unsigned int c = 0, offset = 0; c < csp_buffer_pool_count; c++) {
+
+		csp_buffer_pool_t * pool = &csp_buffer_pools[c];
 
-	if (!csp_buffers)
-		goto fail_queue;
+		pool->memory = &csp_buffer_memory[offset];
+		offset += pool->buffers * pool->skbfsize;
 
-	for (i = 0; i < csp_conf.buffers; i++) {
-		csp_skbf_t * buf = (void *) &csp_buffer_pool[i * skbfsize];
-		buf->skbf_addr = buf;
-		csp_queue_enqueue(csp_buffers, &buf, 0);
+		pool->queue = csp_queue_create(pool->buffers, sizeof(void *));
+
+		if (!pool->queue)
+			goto fail_malloc;
+
+		for (unsigned int i = 0; i < pool->buffers; i++) {
+			csp_skbf_t * buf = (void *) &pool->memory[i * pool->skbfsize];
+			buf->pool = c;
+			buf->skbf_addr = buf;
+			csp_queue_enqueue(pool->queue, &buf, 0);
+		}
+
+		// the configuration reflects the total number of buffers and the largest data size
+		csp_conf.buffers += pool->buffers;
+		csp_conf.buffer_data_size = pool->data_size;
+	}
+
+#if (CSP_BUFFER_USE_CACHE)
+	if (csp_conf.buffer_cache_size) {
+		if (pthread_key_create(&csp_buffer_cache_key, csp_buffer_cache_destroy) != 0)
+			goto fail_malloc;
+		csp_buffer_cache_enabled = 1;
 	}
+#endif
 
 	return CSP_ERR_NONE;
 
-fail_queue:
+fail_inval:
 	csp_buffer_free_resources();
+	return CSP_ERR_INVAL;
+
 fail_malloc:
+	csp_buffer_free_resources();
 	return CSP_ERR_NOMEM;
 }
 
 void csp_buffer_free_resources(void) {
 
-	if (csp_buffers) {
-		csp_queue_remove(csp_buffers);
-		csp_buffers = NULL;
+#if (CSP_BUFFER_USE_CACHE)
+	if (csp_buffer_cache_enabled) {
+		// destructors are not called for a deleted key, so free the caches here
+		pthread_key_delete(csp_buffer_cache_key);
+		csp_buffer_cache_enabled = 0;
+		pthread_mutex_lock(&csp_buffer_cache_lock);
+		while (csp_buffer_caches) {
+			csp_buffer_cache_t * cache = csp_buffer_caches;
+			csp_buffer_caches = cache->next;
+			csp_free(cache);
+		}
+		pthread_mutex_unlock(&csp_buffer_cache_lock);
+	}
+#endif
+
+	for (unsigned int c = 0; c < csp_buffer_pool_count; c++) {
+		csp_buffer_pool_t * pool = &csp_buffer_pools[c];
+
+		if (pool->queue) {
+			csp_queue_remove(pool->queue);
+		}
 	}
 
-	csp_free(csp_buffer_pool);
-	csp_buffer_pool = NULL;
+	memset(csp_buffer_pools, 0, sizeof(csp_buffer_pools));
+	csp_buffer_pool_count = 0;
+
+	csp_free_pool(csp_buffer_memory, csp_buffer_memory_size, csp_buffer_memory_flags);
+	csp_buffer_memory = NULL;
+}
+
+/* Return index of the smallest pool fitting data_size, or -1 if too large */
+static int csp_buffer_pool_index(size_t data_size) {
+
+	int index = -1;
+
+	for (int c = csp_buffer_pool_count - 1; c >= 0; c--) {
+		if (csp_buffer_pools[c].data_size < data_size) {
+			break;
+		}
+		if ((index >= 0) && ((csp_buffer_pools[c].data_size + csp_buffer_tailroom) < (data_size + CSP_BUFFER_TRAILER_RESERVE))) {
+			// prefer the larger pool, this one cannot hold the trailers
+			break;
+		}
+		index = c;
+	}
+
+	return index;
+}
+
+/* Get buffer from pool 'index' or any larger pool */
+static csp_skbf_t * csp_buffer_pool_get(int index) {
+
+	for (; index < (int) csp_buffer_pool_count; index++) {
+		csp_skbf_t * buffer = NULL;
+#if (CSP_BUFFER_USE_CACHE)
+		csp_buffer_cache_t * cache = csp_buffer_cache_get();
+		if (cache) {
+			csp_buffer_magazine_t * mag = &cache->mag[index];
+			if (mag->count == 0) {
+				csp_buffer_cache_refill(mag, &csp_buffer_pools[index]);
+			}
+			if (mag->count) {
+				mag->count--;
+				buffer = mag->skbf[mag->count];
+			}
+		} else
+#endif
+		{
+			csp_queue_dequeue(csp_buffer_pools[index].queue, &buffer, 0);
+		}
+
+		if (buffer) {
+			return buffer;
+		}
+	}
+
+	return NULL;
+}
+
+/* Return buffers (with no references) to pool, through the cache if enabled */
+static void csp_buffer_pool_put(unsigned int index, csp_skbf_t ** skbf, unsigned int count) {
+
+	csp_buffer_pool_t * pool = &csp_buffer_pools[index];
+
+#if (CSP_BUFFER_USE_CACHE)
+	csp_buffer_cache_t * cache = csp_buffer_cache_get();
+	if (cache) {
+		csp_buffer_magazine_t * mag = &cache->mag[index];
+		for (unsigned int i = 0; i < count; i++) {
+			if (mag->count >= csp_conf.buffer_cache_size) {
+				csp_buffer_cache_flush(mag, pool, csp_conf.buffer_cache_size / 2);
+			}
+			mag->skbf[mag->count] = skbf[i];
+			mag->count++;
+		}
+		return;
+	}
+#endif
+
+	while (count) {
+		const int added = csp_queue_enqueue_bulk(pool->queue, skbf, count, 0);
+		if (added <= 0) {
+			break;
+		}
+		skbf += added;
+		count -= added;
+	}
 }
 
 void *csp_buffer_get_isr(size_t _data_size) {
 
-	if (_data_size > csp_conf.buffer_data_size)
+	int index = csp_buffer_pool_index(_data_size);
+	if (index < 0)
 		return NULL;
 
 	csp_skbf_t * buffer = NULL;
 	CSP_BASE_TYPE task_woken = 0;
-	csp_queue_dequeue_isr(csp_buffers, &buffer, &task_woken);
+	for (; (buffer == NULL) && (index < (int) csp_buffer_pool_count); index++) {
+		csp_queue_dequeue_isr(csp_buffer_pools[index].queue, &buffer, &task_woken);
+	}
 
 	if (buffer == NULL)
 		return NULL;
@@ -112,19 +448,21 @@ void *csp_buffer_get_isr(size_t _data_size) {
 		return NULL;
 
 	buffer->refcount = 1;
-	return buffer->skbf_data;
+	buffer->pushed = 0;
+	buffer->next = NULL;
+	return csp_buffer_packet(buffer);
 }
 
 void *csp_buffer_get(size_t _data_size) {
 
-	if (_data_size > csp_conf.buffer_data_size) {
+	int index = csp_buffer_pool_index(_data_size);
+	if (index < 0) {
 		csp_log_error("csp_buffer_get: Attempt to allocate too large data size %u > max %u",
 					  (unsigned int) _data_size, (unsigned int) csp_conf.buffer_data_size);
 		return NULL;
 	}
 
-	csp_skbf_t * buffer = NULL;
-	csp_queue_dequeue(csp_buffers, &buffer, 0);
+	csp_skbf_t * buffer = csp_buffer_pool_get(index);
 	if (buffer == NULL) {
 		csp_log_error("csp_buffer_get: Out of buffers");
 		return NULL;
@@ -139,69 +477,211 @@ void *csp_buffer_get(size_t _data_size) {
 	csp_log_buffer("csp_buffer_get: %p", buffer);
 
 	buffer->refcount = 1;
-	return buffer->skbf_data;
+	buffer->pushed = 0;
+	buffer->next = NULL;
+	return csp_buffer_packet(buffer);
 }
 
 void csp_buffer_free_isr(void *packet) {
 
-	if (packet == NULL) {
-		// freeing a NULL pointer is OK, e.g. standard free()
-		return;
+	// freeing a NULL pointer is OK, e.g. standard free()
+	while (packet != NULL) {
+
+		csp_skbf_t * buf = csp_buffer_skbf(packet);
+
+		if (((uintptr_t) buf % CSP_BUFFER_ALIGN) > 0) {
+			return;
+		}
+
+		if (buf->skbf_addr != buf) {
+			return;
+		}
+
+		if (__atomic_load_n(&buf->refcount, __ATOMIC_RELAXED) == 0) {
+			return;
+		}
+
+		if (__atomic_sub_fetch(&buf->refcount, 1, __ATOMIC_ACQ_REL) > 0) {
+			return;
+		}
+
+		// the chain is owned by the first segment
+		packet = buf->next;
+		buf->next = NULL;
+
+		CSP_BASE_TYPE task_woken = 0;
+		csp_queue_enqueue_isr(csp_buffer_pools[buf->pool].queue, &buf, &task_woken);
 	}
+}
+
+/* Release reference to packet, return buffer header if it must be returned to the pool */
+static csp_skbf_t * csp_buffer_release(void * packet) {
 
-	csp_skbf_t * buf = (void*)(((uint8_t*)packet) - sizeof(csp_skbf_t));
+	csp_skbf_t * buf = csp_buffer_skbf(packet);
 
 	if (((uintptr_t) buf % CSP_BUFFER_ALIGN) > 0) {
-		return;
+		csp_log_error("FREE: Unaligned CSP buffer pointer %p", packet);
+		return NULL;
 	}
 
 	if (buf->skbf_addr != buf) {
-		return;
+		csp_log_error("FREE: Invalid CSP buffer pointer %p", packet);
+		return NULL;
 	}
 
-	if (buf->refcount == 0) {
-		return;
+	if (__atomic_load_n(&buf->refcount, __ATOMIC_RELAXED) == 0) {
+		csp_log_error("FREE: Buffer already free %p", buf);
+		return NULL;
 	}
 
-	if (--(buf->refcount) > 0) {
-		return;
+	const unsigned int refcount = __atomic_sub_fetch(&buf->refcount, 1, __ATOMIC_ACQ_REL);
+	if (refcount > 0) {
+		csp_log_buffer("FREE: Buffer %p still in use by %u users", buf, refcount);
+		return NULL;
 	}
 
-	CSP_BASE_TYPE task_woken = 0;
-	csp_queue_enqueue_isr(csp_buffers, &buf, &task_woken);
+	csp_log_buffer("FREE: %p", buf);
+
+	return buf;
 }
 
 void csp_buffer_free(void *packet) {
 
-	if (packet == NULL) {
-		/* freeing a NULL pointer is OK, e.g. standard free() */
-		return;
+	/* freeing a NULL pointer is OK, e.g. standard free() */
+	while (packet != NULL) {
+
+		csp_skbf_t * buf = csp_buffer_release(packet);
+		if (buf == NULL) {
+			return;
+		}
+
+		// the chain is owned by the first segment
+		packet = buf->next;
+		buf->next = NULL;
+
+		csp_buffer_pool_put(buf->pool, &buf, 1);
 	}
+}
 
-	csp_skbf_t * buf = (void*)(((uint8_t*)packet) - sizeof(csp_skbf_t));
+int csp_buffer_get_bulk(size_t data_size, unsigned int count, void * buffers[]) {
 
-	if (((uintptr_t) buf % CSP_BUFFER_ALIGN) > 0) {
-		csp_log_error("FREE: Unaligned CSP buffer pointer %p", packet);
-		return;
+	int index = csp_buffer_pool_index(data_size);
+	if (index < 0) {
+		csp_log_error("csp_buffer_get_bulk: Attempt to allocate too large data size %u > max %u",
+					  (unsigned int) data_size, (unsigned int) csp_conf.buffer_data_size);
+		return 0;
 	}
 
-	if (buf->skbf_addr != buf) {
-		csp_log_error("FREE: Invalid CSP buffer pointer %p", packet);
-		return;
+	csp_skbf_t ** skbf = (csp_skbf_t **) buffers;
+	unsigned int got = 0;
+
+	for (; (got < count) && (index < (int) csp_buffer_pool_count); index++) {
+#if (CSP_BUFFER_USE_CACHE)
+		csp_buffer_cache_t * cache = csp_buffer_cache_get();
+		if (cache) {
+			// take what the cache holds, the rest directly from the pool
+			csp_buffer_magazine_t * mag = &cache->mag[index];
+			while ((got < count) && mag->count) {
+				mag->count--;
+				skbf[got++] = mag->skbf[mag->count];
+			}
+		}
+#endif
+		while (got < count) {
+			const int n = csp_queue_dequeue_bulk(csp_buffer_pools[index].queue, &skbf[got], count - got, 0);
+			if (n <= 0) {
+				break;
+			}
+			got += n;
+		}
 	}
 
-	if (buf->refcount == 0) {
-		csp_log_error("FREE: Buffer already free %p", buf);
-		return;
+	// drop corrupt buffers, keeping the array compact
+	unsigned int valid = 0;
+	for (unsigned int i = 0; i < got; i++) {
+		if (skbf[i] != skbf[i]->skbf_addr) {
+			csp_log_error("csp_buffer_get_bulk: Corrupt CSP buffer %p != %p",
+						  skbf[i], skbf[i]->skbf_addr);
+			continue;
+		}
+		csp_log_buffer("csp_buffer_get_bulk: %p", skbf[i]);
+		skbf[i]->refcount = 1;
+		skbf[i]->pushed = 0;
+		skbf[i]->next = NULL;
+		buffers[valid++] = csp_buffer_packet(skbf[i]);
 	}
 
-	if (--(buf->refcount) > 0) {
-		csp_log_error("FREE: Buffer %p in use by %u users", buf, buf->refcount);
-		return;
+	if (valid < count) {
+		csp_log_error("csp_buffer_get_bulk: Out of buffers, got %u of %u", valid, count);
 	}
 
-	csp_log_buffer("FREE: %p", buf);
-	csp_queue_enqueue(csp_buffers, &buf, 0);
+	return valid;
+}
+
+void csp_buffer_free_bulk(unsigned int count, void * buffers[]) {
+
+	// buffers to return, collected per pool so each pool queue is locked once per batch
+	csp_skbf_t * batch[16];
+	unsigned int batch_count = 0;
+	unsigned int batch_pool = 0;
+
+	for (unsigned int i = 0; i < count; i++) {
+
+		void * packet = buffers[i];
+
+		while (packet != NULL) {
+
+			csp_skbf_t * buf = csp_buffer_release(packet);
+			if (buf == NULL) {
+				break;
+			}
+
+			packet = buf->next;
+			buf->next = NULL;
+
+			if (batch_count && ((batch_pool != buf->pool) || (batch_count >= (sizeof(batch) / sizeof(batch[0]))))) {
+				csp_buffer_pool_put(batch_pool, batch, batch_count);
+				batch_count = 0;
+			}
+			batch_pool = buf->pool;
+			batch[batch_count++] = buf;
+		}
+	}
+
+	if (batch_count) {
+		csp_buffer_pool_put(batch_pool, batch, batch_count);
+	}
+}
+
+/* Clone a single segment, not the chain */
+static csp_packet_t * csp_buffer_clone_segment(const csp_packet_t * packet) {
+
+	// clone into the same size class, so the clone has the same room as the original
+	const csp_skbf_t * buf = csp_buffer_skbf(packet);
+	csp_skbf_t * clone = csp_buffer_pool_get(buf->pool);
+	if (clone == NULL) {
+		csp_log_error("csp_buffer_clone: Out of buffers");
+		return NULL;
+	}
+
+	if (clone != clone->skbf_addr) {
+		csp_log_error("csp_buffer_clone: Corrupt CSP buffer %p != %p",
+					  clone, clone->skbf_addr);
+		return NULL;
+	}
+
+	clone->refcount = 1;
+	clone->pushed = 0;
+	clone->next = NULL;
+
+	// only copy the used part of the buffer (headers added by csp_packet_push() are not copied)
+	size_t length = packet->length;
+	if (length > (csp_buffer_pools[buf->pool].data_size + csp_buffer_tailroom)) {
+		length = csp_buffer_pools[buf->pool].data_size + csp_buffer_tailroom;
+	}
+	memcpy(csp_buffer_packet(clone), packet, CSP_BUFFER_PACKET_OVERHEAD + length);
+
+	return csp_buffer_packet(clone);
 }
 
 void *csp_buffer_clone(void *buffer) {
@@ -211,16 +691,85 @@ void *csp_buffer_clone(void *buffer) {
 		return NULL;
 	}
 
-	csp_packet_t *clone = csp_buffer_get(packet->length);
-	if (clone) {
-		memcpy(clone, packet, csp_buffer_size());
+	csp_packet_t * clone = csp_buffer_clone_segment(packet);
+	if (clone == NULL) {
+		return NULL;
+	}
+
+	// clone the remaining segments of a chain
+	csp_packet_t * tail = clone;
+	for (packet = csp_packet_next(packet); packet; packet = csp_packet_next(packet)) {
+		csp_packet_t * segment = csp_buffer_clone_segment(packet);
+		if (segment == NULL) {
+			csp_buffer_free(clone);
+			return NULL;
+		}
+		csp_buffer_skbf(tail)->next = segment;
+		tail = segment;
 	}
 
 	return clone;
 }
 
+void *csp_buffer_ref(void *buffer) {
+
+	if (buffer == NULL) {
+		return NULL;
+	}
+
+	csp_skbf_t * buf = csp_buffer_skbf(buffer);
+
+	if (buf->skbf_addr != buf) {
+		csp_log_error("REF: Invalid CSP buffer pointer %p", buffer);
+		return NULL;
+	}
+
+	if (__atomic_load_n(&buf->refcount, __ATOMIC_RELAXED) == 0) {
+		csp_log_error("REF: Buffer is free %p", buf);
+		return NULL;
+	}
+
+	__atomic_add_fetch(&buf->refcount, 1, __ATOMIC_RELAXED);
+
+	return buffer;
+}
+
+void *csp_buffer_writable(void *buffer) {
+
+	if (buffer == NULL) {
+		return NULL;
+	}
+
+	const csp_skbf_t * buf = csp_buffer_skbf(buffer);
+
+	if (__atomic_load_n(&buf->refcount, __ATOMIC_ACQUIRE) <= 1) {
+		return buffer;
+	}
+
+	return csp_buffer_clone(buffer);
+}
+
 int csp_buffer_remaining(void) {
-	return csp_queue_size(csp_buffers);
+
+	int remaining = 0;
+
+	for (unsigned int c = 0; c < csp_buffer_pool_count; c++) {
+		remaining += csp_queue_size(csp_buffer_pools[c].queue);
+	}
+
+#if (CSP_BUFFER_USE_CACHE)
+	if (csp_buffer_cache_enabled) {
+		pthread_mutex_lock(&csp_buffer_cache_lock);
+		for (csp_buffer_cache_t * cache = csp_buffer_caches; cache; cache = cache->next) {
+			for (unsigned int c = 0; c < csp_buffer_pool_count; c++) {
+				remaining += cache->mag[c].count;
+			}
+		}
+		pthread_mutex_unlock(&csp_buffer_cache_lock);
+	}
+#endif
+
+	return remaining;
 }
 
 size_t csp_buffer_size(void) {
@@ -230,3 +779,165 @@ size_t csp_buffer_size(void) {
 size_t csp_buffer_data_size(void) {
 	return csp_conf.buffer_data_size;
 }
+
+size_t csp_buffer_data_size_of(const void * buffer) {
+
+	if (buffer == NULL) {
+		return 0;
+	}
+
+	const csp_skbf_t * buf = csp_buffer_skbf(buffer);
+	return csp_buffer_pools[buf->pool].data_size;
+}
+
+size_t csp_packet_headroom(const csp_packet_t * packet) {
+
+	const csp_skbf_t * buf = csp_buffer_skbf(packet);
+	return CSP_BUFFER_HEAD_ROOM - buf->pushed;
+}
+
+size_t csp_packet_tailroom(const csp_packet_t * packet) {
+
+	const csp_skbf_t * buf = csp_buffer_skbf(packet);
+	const size_t size = csp_buffer_pools[buf->pool].data_size + csp_buffer_tailroom;
+	return (packet->length < size) ? (size - packet->length) : 0;
+}
+
+void * csp_packet_push(csp_packet_t * packet, size_t len) {
+
+	csp_skbf_t * buf = csp_buffer_skbf(packet);
+
+	if (__atomic_load_n(&buf->refcount, __ATOMIC_ACQUIRE) > 1) {
+		csp_log_error("csp_packet_push: Buffer is shared %p", buf);
+		return NULL;
+	}
+
+	if ((buf->pushed + len) > CSP_BUFFER_HEAD_ROOM) {
+		csp_log_error("csp_packet_push: No headroom for %u bytes, %u available",
+					  (unsigned int) len, (unsigned int) (CSP_BUFFER_HEAD_ROOM - buf->pushed));
+		return NULL;
+	}
+
+	buf->pushed += len;
+	return ((uint8_t *) &packet->id) - buf->pushed;
+}
+
+void * csp_packet_pull(csp_packet_t * packet, size_t len) {
+
+	csp_skbf_t * buf = csp_buffer_skbf(packet);
+
+	if (len > buf->pushed) {
+		return NULL;
+	}
+
+	uint8_t * head = ((uint8_t *) &packet->id) - buf->pushed;
+	buf->pushed -= len;
+	return head;
+}
+
+void * csp_packet_put(csp_packet_t * packet, size_t len) {
+
+	const csp_skbf_t * buf = csp_buffer_skbf(packet);
+
+	if (__atomic_load_n(&buf->refcount, __ATOMIC_ACQUIRE) > 1) {
+		csp_log_error("csp_packet_put: Buffer is shared %p", buf);
+		return NULL;
+	}
+
+	if (len > csp_packet_tailroom(packet)) {
+		return NULL;
+	}
+
+	uint8_t * tail = &packet->data[packet->length];
+	packet->length += len;
+	return tail;
+}
+
+void * csp_packet_trim(csp_packet_t * packet, size_t len) {
+
+	if (len > packet->length) {
+		return NULL;
+	}
+
+	packet->length -= len;
+	return &packet->data[packet->length];
+}
+
+csp_packet_t * csp_packet_next(const csp_packet_t * packet) {
+
+	return csp_buffer_skbf(packet)->next;
+}
+
+int csp_packet_chain(csp_packet_t * packet, csp_packet_t * segment) {
+
+	if ((packet == NULL) || (segment == NULL) || (segment == packet)) {
+		return CSP_ERR_INVAL;
+	}
+
+	csp_skbf_t * buf = csp_buffer_skbf(packet);
+	if (__atomic_load_n(&buf->refcount, __ATOMIC_ACQUIRE) > 1) {
+		csp_log_error("csp_packet_chain: Buffer is shared %p", buf);
+		return CSP_ERR_INVAL;
+	}
+
+	while (buf->next) {
+		buf = csp_buffer_skbf(buf->next);
+	}
+	buf->next = segment;
+
+	return CSP_ERR_NONE;
+}
+
+size_t csp_packet_chain_length(const csp_packet_t * packet) {
+
+	size_t length = 0;
+	for (; packet; packet = csp_packet_next(packet)) {
+		length += packet->length;
+	}
+	return length;
+}
+
+csp_packet_t * csp_buffer_get_chain(size_t length) {
+
+	csp_packet_t * head = NULL;
+
+	do {
+		const size_t size = (length < csp_conf.buffer_data_size) ? length : csp_conf.buffer_data_size;
+		csp_packet_t * segment = csp_buffer_get(size);
+		if (segment == NULL) {
+			csp_buffer_free(head);
+			return NULL;
+		}
+		segment->length = size;
+		if (head == NULL) {
+			head = segment;
+		} else {
+			csp_packet_chain(head, segment);
+		}
+		length -= size;
+	} while (length);
+
+	return head;
+}
+
+csp_packet_t * csp_packet_linearize(csp_packet_t * packet) {
+
+	if ((packet == NULL) || (csp_packet_next(packet) == NULL)) {
+		return packet;
+	}
+
+	const size_t length = csp_packet_chain_length(packet);
+	csp_packet_t * linear = csp_buffer_get(length);
+	if (linear == NULL) {
+		return NULL;
+	}
+
+	memcpy(linear, packet, CSP_BUFFER_PACKET_OVERHEAD);
+	linear->length = 0;
+	for (; packet; packet = csp_packet_next(packet)) {
+		memcpy(&linear->data[linear->length], packet->data, packet->length);
+		linear->length += packet->length;
+	}
+
+	return linear;
+}
@@ -30,6 +30,7 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
 
 #include "csp_conn.h"
 #include "csp_init.h"
+#include "csp_poll.h"
 #include "transport/csp_transport.h"
 
 /* Connection pool */
@@ -38,23 +39,30 @@ static csp_conn_t * arr_conn;
 /* Connection pool lock */
 static csp_bin_sem_handle_t conn_lock;
 
-/* Last used 'source' port */
-static uint8_t sport;
+/* Lookup index of open client connections, hash of idin (connection mask) */
+static csp_conn_t ** conn_hash;
+static unsigned int conn_hash_bits;
 
-/* Source port lock */
-static csp_bin_sem_handle_t sport_lock;
+/* Index sequence, odd while the index is being modified (with the connection pool locked) */
+static uint32_t conn_seq;
 
-void csp_conn_check_timeouts(void) {
-#if (CSP_USE_RDP)
-	for (int i = 0; i < csp_conf.conn_max; i++) {
-		if (arr_conn[i].state == CONN_OPEN) {
-			if (arr_conn[i].idin.flags & CSP_FRDP) {
-				csp_rdp_check_timeouts(&arr_conn[i]);
-			}
-		}
-	}
-#endif
-}
+/* End of free list */
+#define CSP_CONN_FREE_END	0xFFFF
+
+/* Free list of closed connections: index of first free connection (low 16 bits), and a tag (high 16 bits)
+   incremented on every change, so a pop can't succeed with a stale next index (ABA) */
+static uint32_t conn_free;
+
+/* Max number of ephemeral port bitmaps, one per remote (node, port) */
+#define CSP_CONN_SPORT_BITS	(CSP_ID_HOST_SIZE + CSP_ID_PORT_SIZE)
+
+/* Ephemeral ports in use by csp_connect(), bitmap (2 x 32 ports) per remote (node, port) - remotes share
+   a bitmap if there are fewer bitmaps than remotes, i.e. their ports are allocated from the same range */
+static uint32_t (* sport_map)[2];
+static unsigned int sport_map_bits;
+
+/* Last used 'source' port */
+static uint8_t sport;
 
 int csp_conn_get_rxq(int prio) {
 
@@ -79,22 +87,16 @@ int csp_conn_enqueue_packet(csp_conn_t * conn, csp_packet_t * packet) {
 		rxq = CSP_RX_QUEUES - 1;
 	}
 
-	if (csp_queue_enqueue(conn->rx_queue[rxq], &packet, 0) != CSP_QUEUE_OK) {
-		csp_log_error("RX queue %p full with %u items",
-					  conn->rx_queue[rxq], csp_queue_size(conn->rx_queue[rxq]));
+	const csp_conn_rx_t element = {.packet = packet, .timestamp = csp_aqm_enabled() ? csp_get_ms() : 0};
+
+	if (csp_pqueue_enqueue(conn->rx_queue, rxq, &element) != CSP_QUEUE_OK) {
+		csp_log_error("RX queue %p:%d full with %u items",
+					  conn->rx_queue, rxq, csp_pqueue_size(conn->rx_queue, rxq));
+		conn->aqm.stats.tail_drops++;
 		return CSP_ERR_NOMEM;
 	}
 
-#if (CSP_USE_QOS)
-	{
-		int event = 0;
-
-		if (csp_queue_enqueue(conn->rx_event, &event, 0) != CSP_QUEUE_OK) {
-			csp_log_error("QOS event queue full");
-			return CSP_ERR_NOMEM;
-		}
-	}
-#endif
+	csp_poll_notify(conn);
 
 	return CSP_ERR_NONE;
 }
@@ -102,7 +104,11 @@ int csp_conn_enqueue_packet(csp_conn_t * conn, csp_packet_t * packet) {
 int csp_conn_init(void) {
 
 	int i;
-	int prio;
+
+	if ((csp_conf.conn_max == 0) || (csp_conf.conn_max > CSP_CONN_MAX)) {
+		csp_log_error("Invalid number of connections %u, max %u", csp_conf.conn_max, CSP_CONN_MAX);
+		return CSP_ERR_INVAL;
+	}
 
 	arr_conn = csp_calloc(csp_conf.conn_max, sizeof(*arr_conn));
 
@@ -116,180 +122,272 @@ int csp_conn_init(void) {
 		return CSP_ERR_NOMEM;
 	}
 
+	/* At least as many buckets as connections */
+	conn_hash_bits = 3;
+	while ((1U << conn_hash_bits) < csp_conf.conn_max) {
+		conn_hash_bits++;
+	}
+
+	conn_hash = csp_calloc(1U << conn_hash_bits, sizeof(*conn_hash));
+	if (conn_hash == NULL) {
+		csp_log_error("Allocation for connection index failed");
+		return CSP_ERR_NOMEM;
+	}
+
 	/* Initialize source port */
+	if (csp_conf.port_max_bind >= CSP_ID_PORT_MAX) {
+		csp_log_error("No ephemeral ports, port_max_bind %u", csp_conf.port_max_bind);
+		return CSP_ERR_INVAL;
+	}
 	srand(csp_get_ms());
 	sport = (rand() % (CSP_ID_PORT_MAX - csp_conf.port_max_bind)) + (csp_conf.port_max_bind + 1);
 
-	if (csp_bin_sem_create(&sport_lock) != CSP_SEMAPHORE_OK) {
-		csp_log_error("csp_bin_sem_create(&sport_lock) failed");
+	/* A bitmap per bucket of the lookup index is plenty, as each connection uses one port */
+	sport_map_bits = (conn_hash_bits < CSP_CONN_SPORT_BITS) ? conn_hash_bits : CSP_CONN_SPORT_BITS;
+	sport_map = csp_calloc(1U << sport_map_bits, sizeof(*sport_map));
+	if (sport_map == NULL) {
+		csp_log_error("Allocation for ephemeral ports failed");
 		return CSP_ERR_NOMEM;
 	}
 
+	/* Connection queues are created on first use, see csp_conn_create_queues() */
 	for (i = 0; i < csp_conf.conn_max; i++) {
 		csp_conn_t * conn = &arr_conn[i];
-
-		for (prio = 0; prio < CSP_RX_QUEUES; prio++) {
-			conn->rx_queue[prio] = csp_queue_create(csp_conf.conn_queue_length, sizeof(csp_packet_t *));
-			if (conn->rx_queue[prio] == NULL) {
-				csp_log_error("rx_queue = csp_queue_create() failed");
-				return CSP_ERR_NOMEM;
-			}
-		}
-
-#if (CSP_USE_QOS)
-		conn->rx_event = csp_queue_create(csp_conf.conn_queue_length, sizeof(int));
-
-		if (conn->rx_event == NULL) {
-			csp_log_error("rx_event = csp_queue_create() failed");
-			return CSP_ERR_NOMEM;
-		}
-#endif
-
-#if (CSP_USE_RDP)
-		if (csp_rdp_init(conn) != CSP_ERR_NONE) {
-			csp_log_error("csp_rdp_allocate(conn) failed");
-			return CSP_ERR_NOMEM;
-		}
-#endif
+		conn->free_next = ((i + 1) < csp_conf.conn_max) ? (i + 1) : CSP_CONN_FREE_END;
 	}
 
+	conn_free = 0;
+
 	return CSP_ERR_NONE;
 }
 
 void csp_conn_free_resources(void) {
 
 	unsigned int i;
-	int prio;
 
 	if (arr_conn) {
 		for (i = 0; i < csp_conf.conn_max; i++) {
 			csp_conn_t * conn = &arr_conn[i];
 
-			for (prio = 0; prio < CSP_RX_QUEUES; prio++) {
-				if (conn->rx_queue[prio]) {
-					csp_queue_remove(conn->rx_queue[prio]);
-				}
-			}
-
-#if (CSP_USE_QOS)
-			if (conn->rx_event) {
-				csp_queue_remove(conn->rx_event);
-			}
-#endif
+			csp_pqueue_remove(conn->rx_queue);
 
 #if (CSP_USE_RDP)
-			csp_rdp_free_resources(conn);
+			if (conn->rdp.tx_queue) {
+				csp_rdp_free_resources(conn);
+			}
 #endif
 		}
 
 		csp_free(arr_conn);
 		arr_conn = NULL;
 
+		csp_free(conn_hash);
+		conn_hash = NULL;
+		csp_free(sport_map);
+		sport_map = NULL;
+		conn_free = CSP_CONN_FREE_END;
+
 		//csp_bin_sem_remove(&conn_lock);
 		memset(&conn_lock, 0, sizeof(conn_lock));
 
-		//csp_bin_sem_remove(&sport_lock);
-		memset(&sport_lock, 0, sizeof(sport_lock));
-
 		sport = 0;
 	}
 }
 
-csp_conn_t * csp_conn_find(uint32_t id, uint32_t mask) {
+bool csp_conn_match(const csp_conn_t * conn, uint32_t id, uint32_t mask) {
 
-	int i;
+	return ((conn->state == CONN_OPEN) &&
+			(conn->type == CONN_CLIENT) &&
+			((conn->idin.ext & mask) == (id & mask)));
+}
 
-	/* Search for matching connection */
-	id = (id & mask);
+static inline unsigned int csp_conn_hash(uint32_t id) {
 
-	for (i = 0; i < csp_conf.conn_max; i++) {
-		csp_conn_t * conn = &arr_conn[i];
+	return (uint32_t)((id & CSP_ID_CONN_MASK) * UINT32_C(0x9E3779B1)) >> (32 - conn_hash_bits);
+}
 
-		if ((conn->state == CONN_OPEN) &&
-			(conn->type == CONN_CLIENT) &&
-			((conn->idin.ext & mask) == id))
-		{
-			return conn;
+/* Add connection to the lookup index, conn_lock must be held */
+static void csp_conn_index_add(csp_conn_t * conn) {
+
+	csp_conn_t ** bucket = &conn_hash[csp_conn_hash(conn->idin.ext)];
+
+	__atomic_add_fetch(&conn_seq, 1, __ATOMIC_ACQ_REL);
+	conn->hash_next = *bucket;
+	__atomic_store_n(bucket, conn, __ATOMIC_RELEASE);
+	__atomic_add_fetch(&conn_seq, 1, __ATOMIC_ACQ_REL);
+}
+
+/* Remove connection from the lookup index, conn_lock must be held */
+static void csp_conn_index_remove(csp_conn_t * conn) {
+
+	csp_conn_t ** link;
+
+	__atomic_add_fetch(&conn_seq, 1, __ATOMIC_ACQ_REL);
+	for (link = &conn_hash[csp_conn_hash(conn->idin.ext)]; *link; link = &(*link)->hash_next) {
+		if (*link == conn) {
+			__atomic_store_n(link, conn->hash_next, __ATOMIC_RELEASE);
+			break;
 		}
 	}
-
-	return NULL;
+	__atomic_add_fetch(&conn_seq, 1, __ATOMIC_ACQ_REL);
 }
 
-static int csp_conn_flush_rx_queue(csp_conn_t * conn) {
+/* Search the lookup index, or all connections for other masks than the index key */
+static csp_conn_t * csp_conn_search(uint32_t id, uint32_t mask) {
 
-	int prio;
-	csp_packet_t * packet;
+	unsigned int steps = 0;
+	csp_conn_t * conn;
 
-	/* Flush packet queues */
-	for (prio = 0; prio < CSP_RX_QUEUES; prio++) {
-		while (csp_queue_dequeue(conn->rx_queue[prio], &packet, 0) == CSP_QUEUE_OK)
-			if (packet != NULL)
-				csp_buffer_free(packet);
+	if (mask == CSP_ID_CONN_MASK) {
+		conn = __atomic_load_n(&conn_hash[csp_conn_hash(id)], __ATOMIC_ACQUIRE);
+		/* Steps are limited, as the index may change while following the chain */
+		for (; conn && (steps < csp_conf.conn_max); conn = __atomic_load_n(&conn->hash_next, __ATOMIC_ACQUIRE), steps++) {
+			if (csp_conn_match(conn, id, mask)) {
+				return conn;
+			}
+		}
+		return NULL;
 	}
 
-	/* Flush event queue */
-#if (CSP_USE_QOS)
-	{
-		int event;
-		while (csp_queue_dequeue(conn->rx_event, &event, 0) == CSP_QUEUE_OK)
-			;
+	for (unsigned int i = 0; i < csp_conf.conn_max; i++) {
+		conn = &arr_conn[i];
+		if (csp_conn_match(conn, id, mask)) {
+			return conn;
+		}
 	}
-#endif
 
-	return CSP_ERR_NONE;
+	return NULL;
 }
 
-csp_conn_t * csp_conn_allocate(csp_conn_type_t type) {
+csp_conn_t * csp_conn_find(uint32_t id, uint32_t mask) {
 
-	static uint8_t csp_conn_last_given = 0;
+	/* Lock-free lookup, valid if the index was not modified meanwhile */
+	const uint32_t seq = __atomic_load_n(&conn_seq, __ATOMIC_ACQUIRE);
+	if ((seq & 1) == 0) {
+		csp_conn_t * conn = csp_conn_search(id, mask);
+		if (__atomic_load_n(&conn_seq, __ATOMIC_ACQUIRE) == seq) {
+			return conn;
+		}
+	}
 
+	/* Otherwise wait for the modification to complete (don't spin, the modifying task may have lower priority) */
 	if (csp_bin_sem_wait(&conn_lock, CSP_MAX_TIMEOUT) != CSP_SEMAPHORE_OK) {
 		csp_log_error("Failed to lock conn array");
 		return NULL;
 	}
 
-	/* Search for free connection */
-	csp_conn_t * conn = NULL;
-	int i = csp_conn_last_given;
-	int j;
+	csp_conn_t * conn = csp_conn_search(id, mask);
 
-	for (j = 0; j < csp_conf.conn_max; j++) {
-		i = (i + 1) % csp_conf.conn_max;
-		conn = &arr_conn[i];
-		if (conn->state == CONN_CLOSED) {
-			break;
-		}
+	csp_bin_sem_post(&conn_lock);
+
+	return conn;
+}
+
+static int csp_conn_flush_rx_queue(csp_conn_t * conn) {
+
+	csp_conn_rx_t elements[16];
+	void * packets[16];
+	int count;
+
+	if (conn->rx_queue == NULL) {
+		return CSP_ERR_NONE;
 	}
 
-	if (conn && (conn->state == CONN_CLOSED)) {
-		conn->idin.ext = 0;
-		conn->idout.ext = 0;
-		conn->socket = NULL;
-		conn->timestamp = 0;
-		conn->type = type;
-		conn->state = CONN_OPEN;
-		csp_conn_last_given = i;
-	} else {
-		// no free connections
-		conn = NULL;
+	/* Flush packet queue */
+	while ((count = csp_pqueue_dequeue_bulk(conn->rx_queue, elements, sizeof(elements) / sizeof(elements[0]), 0)) > 0) {
+		for (int i = 0; i < count; i++) {
+			packets[i] = elements[i].packet;
+		}
+		csp_buffer_free_bulk(count, packets);
 	}
 
-	csp_bin_sem_post(&conn_lock);
+	return CSP_ERR_NONE;
+}
 
-	if (conn == NULL) {
-		csp_log_error("No free connections, max %u", csp_conf.conn_max);
-		// TODO explicit return?
-	}
+/* Return a closed connection to the free list */
+static void csp_conn_free(csp_conn_t * conn) {
+
+	const uint16_t index = conn - arr_conn;
+	uint32_t head = __atomic_load_n(&conn_free, __ATOMIC_RELAXED);
+	uint32_t next;
+
+	do {
+		__atomic_store_n(&conn->free_next, head & 0xFFFF, __ATOMIC_RELAXED);
+		next = ((head + 0x10000) & 0xFFFF0000) | index;
+	} while (!__atomic_compare_exchange_n(&conn_free, &head, next, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+csp_conn_t * csp_conn_allocate(csp_conn_type_t type) {
+
+	/* Take first connection from the free list */
+	csp_conn_t * conn;
+	uint32_t head = __atomic_load_n(&conn_free, __ATOMIC_ACQUIRE);
+	uint32_t next;
+
+	do {
+		if ((head & 0xFFFF) == CSP_CONN_FREE_END) {
+			csp_log_error("No free connections, max %u", csp_conf.conn_max);
+			return NULL;
+		}
+		/* free_next may be stale, if the connection was taken meanwhile - the tag then fails the exchange */
+		conn = &arr_conn[head & 0xFFFF];
+		next = ((head + 0x10000) & 0xFFFF0000) | __atomic_load_n(&conn->free_next, __ATOMIC_RELAXED);
+	} while (!__atomic_compare_exchange_n(&conn_free, &head, next, true, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE));
+
+	conn->idin.ext = 0;
+	conn->idout.ext = 0;
+	conn->socket = NULL;
+	conn->timestamp = 0;
+	conn->type = type;
+	conn->state = CONN_OPEN;
 
 	return conn;
 }
 
+/**
+ * Create connection queues, if not already created by a previous user of the connection.
+ * Queues are kept when the connection is closed, and as the free list returns the most recently closed connection
+ * first, only about as many connections as are open at the same time will ever have queues.
+ * @param conn connection
+ * @param rdp create RDP queues
+ * @return CSP_ERR type
+ */
+static int csp_conn_create_queues(csp_conn_t * conn, bool rdp) {
+
+	if (conn->rx_queue == NULL) {
+		conn->rx_queue = csp_pqueue_create(CSP_RX_QUEUES, csp_conf.conn_queue_length, sizeof(csp_conn_rx_t));
+		if (conn->rx_queue == NULL) {
+			csp_log_error("rx_queue = csp_pqueue_create() failed");
+			return CSP_ERR_NOMEM;
+		}
+	}
+
+#if (CSP_USE_RDP)
+	if (rdp && (conn->rdp.tx_queue == NULL)) {
+		if (csp_rdp_init(conn) != CSP_ERR_NONE) {
+			csp_log_error("csp_rdp_allocate(conn) failed");
+			conn->rdp.tx_queue = NULL;
+			return CSP_ERR_NOMEM;
+		}
+	}
+#else
+	(void) rdp;
+#endif
+
+	return CSP_ERR_NONE;
+}
+
 csp_conn_t * csp_conn_new(csp_id_t idin, csp_id_t idout) {
 
 	/* Allocate connection structure */
 	csp_conn_t * conn = csp_conn_allocate(CONN_CLIENT);
 
+	if (conn && (csp_conn_create_queues(conn, (idin.flags | idout.flags) & CSP_FRDP) != CSP_ERR_NONE)) {
+		conn->state = CONN_CLOSED;
+		csp_conn_free(conn);
+		conn = NULL;
+	}
+
 	if (conn) {
 		/* No lock is needed here, because nobody else *
 		 * has a reference to this connection yet.	   */
@@ -299,11 +397,105 @@ csp_conn_t * csp_conn_new(csp_id_t idin, csp_id_t idout) {
 
 		/* Ensure connection queue is empty */
 		csp_conn_flush_rx_queue(conn);
+		memset(&conn->aqm, 0, sizeof(conn->aqm));
+
+		/* Make the connection visible to csp_conn_find() */
+		if (csp_bin_sem_wait(&conn_lock, CSP_MAX_TIMEOUT) != CSP_SEMAPHORE_OK) {
+			csp_log_error("Failed to lock conn array");
+			conn->state = CONN_CLOSED;
+			csp_conn_free(conn);
+			return NULL;
+		}
+		csp_conn_index_add(conn);
+		csp_bin_sem_post(&conn_lock);
 	}
 
 	return conn;
 }
 
+/* Ports in a range of a bitmap word, from port 'first' */
+static inline uint32_t csp_conn_sport_range(unsigned int word, unsigned int first) {
+
+	if (first >= (word + 1) * 32) {
+		return 0;
+	}
+	return (first <= (word * 32)) ? UINT32_MAX : (UINT32_MAX << (first - (word * 32)));
+}
+
+/* Bitmap of a remote (node, port) */
+static inline uint32_t * csp_conn_sport_map(uint8_t node, uint8_t port) {
+
+	const uint32_t remote = ((uint32_t) node << CSP_ID_PORT_SIZE) | port;
+
+	if (sport_map_bits == CSP_CONN_SPORT_BITS) {
+		return sport_map[remote];
+	}
+	return sport_map[(uint32_t)(remote * UINT32_C(0x9E3779B1)) >> (32 - sport_map_bits)];
+}
+
+/* First free ephemeral port from port 'first', not in map or skip, or -1 */
+static int csp_conn_sport_find(const uint32_t * map, const uint32_t * skip, unsigned int first) {
+
+	if (first <= csp_conf.port_max_bind) {
+		first = csp_conf.port_max_bind + 1;
+	}
+
+	for (unsigned int word = 0; word < 2; word++) {
+		const uint32_t free = ~(__atomic_load_n(&map[word], __ATOMIC_RELAXED) | skip[word]) & csp_conn_sport_range(word, first);
+		if (free) {
+			return (word * 32) + __builtin_ctz(free);
+		}
+	}
+
+	return -1;
+}
+
+/**
+ * Allocate an ephemeral port for a connection to a remote node and port.
+ * Ports are handed out round robin (from after the last used port), so a port is not reused immediately.
+ * The bitmaps only hold ports allocated here, so a port is skipped if a connection accepted by a socket
+ * (e.g. bound to #CSP_ANY) already uses it with the remote.
+ * @param incoming_id identifier of incoming packets on the new connection, except destination port
+ * @return port, or -1 if all ports are in use
+ */
+static int csp_conn_sport_alloc(csp_id_t incoming_id) {
+
+	uint32_t * map = csp_conn_sport_map(incoming_id.src, incoming_id.sport);
+	uint32_t skip[2] = {0, 0};
+
+	while (1) {
+		int sp = csp_conn_sport_find(map, skip, __atomic_load_n(&sport, __ATOMIC_RELAXED) + 1);
+		if (sp < 0) {
+			sp = csp_conn_sport_find(map, skip, 0);
+			if (sp < 0) {
+				return -1;
+			}
+		}
+
+		/* Claim port, unless another task got it first */
+		const uint32_t bit = 1UL << (sp % 32);
+		if (__atomic_fetch_or(&map[sp / 32], bit, __ATOMIC_ACQ_REL) & bit) {
+			continue;
+		}
+
+		incoming_id.dport = sp;
+		if (csp_conn_find(incoming_id.ext, CSP_ID_CONN_MASK) == NULL) {
+			__atomic_store_n(&sport, sp, __ATOMIC_RELAXED);
+			return sp;
+		}
+
+		/* In use by an accepted connection */
+		__atomic_fetch_and(&map[sp / 32], ~bit, __ATOMIC_RELEASE);
+		skip[sp / 32] |= bit;
+	}
+}
+
+static void csp_conn_sport_free(uint8_t node, uint8_t port, uint8_t sp) {
+
+	uint32_t * map = csp_conn_sport_map(node, port);
+	__atomic_fetch_and(&map[sp / 32], ~(1UL << (sp % 32)), __ATOMIC_RELEASE);
+}
+
 int csp_close(csp_conn_t * conn) {
 	return csp_conn_close(conn, CSP_RDP_CLOSED_BY_USERSPACE);
 }
@@ -335,9 +527,19 @@ int csp_conn_close(csp_conn_t * conn, uint8_t closed_by) {
 		return CSP_ERR_TIMEDOUT;
 	}
 
+	/* Closed by another task meanwhile */
+	if (conn->state == CONN_CLOSED) {
+		csp_bin_sem_post(&conn_lock);
+		return CSP_ERR_NONE;
+	}
+
 	/* Set to closed */
 	conn->state = CONN_CLOSED;
 
+	if (conn->type == CONN_CLIENT) {
+		csp_conn_index_remove(conn);
+	}
+
 	/* Ensure connection queue is empty */
 	csp_conn_flush_rx_queue(conn);
 
@@ -356,6 +558,15 @@ int csp_conn_close(csp_conn_t * conn, uint8_t closed_by) {
 	/* Unlock connection array */
 	csp_bin_sem_post(&conn_lock);
 
+	/* Release ephemeral port */
+	if (conn->ephemeral) {
+		conn->ephemeral = 0;
+		csp_conn_sport_free(conn->idout.dst, conn->idout.dport, conn->idout.sport);
+	}
+
+	/* Connection can be reused */
+	csp_conn_free(conn);
+
 	return CSP_ERR_NONE;
 }
 
@@ -425,38 +636,24 @@ csp_conn_t * csp_connect(uint8_t prio, uint8_t dest, uint8_t dport, uint32_t tim
 	}
 
 	/* Find an unused ephemeral port */
-	csp_conn_t * conn = NULL;
-
-	/* Wait for sport lock - note that csp_conn_new(..) is called inside the lock! */
-	if (csp_bin_sem_wait(&sport_lock, CSP_MAX_TIMEOUT) != CSP_SEMAPHORE_OK) {
+	const int port = csp_conn_sport_alloc(incoming_id);
+	if (port < 0) {
+		csp_log_error("No free ephemeral ports for %u:%u", dest, dport);
 		return NULL;
 	}
 
-	const uint8_t start = sport;
-
-	while (++sport != start) {
-		if (sport > CSP_ID_PORT_MAX)
-			sport = csp_conf.port_max_bind + 1;
-
-		outgoing_id.sport = sport;
-		incoming_id.dport = sport;
-
-		/* Match on destination port of _incoming_ identifier */
-		if (csp_conn_find(incoming_id.ext, CSP_ID_DPORT_MASK) == NULL) {
-			/* Break - we found an unused ephemeral port
-			   allocate connection while locked to mark port in use */
-			conn = csp_conn_new(incoming_id, outgoing_id);
-			break;
-		}
-	}
-
-	/* Post sport lock */
-	csp_bin_sem_post(&sport_lock);
+	outgoing_id.sport = port;
+	incoming_id.dport = port;
 
+	csp_conn_t * conn = csp_conn_new(incoming_id, outgoing_id);
 	if (conn == NULL) {
+		csp_conn_sport_free(dest, dport, port);
 		return NULL;
 	}
 
+	/* Released by csp_conn_close() */
+	conn->ephemeral = 1;
+
 	/* Set connection options */
 	conn->opts = opts;
 
@@ -496,6 +693,16 @@ int csp_conn_flags(csp_conn_t * conn) {
 	return conn->idin.flags;
 }
 
+int csp_conn_get_queue_stats(csp_conn_t * conn, csp_queue_stats_t * stats) {
+
+	if ((conn == NULL) || (stats == NULL)) {
+		return CSP_ERR_INVAL;
+	}
+
+	*stats = conn->aqm.stats;
+	return CSP_ERR_NONE;
+}
+
 void csp_conn_print_table(void) {
 
 	for (unsigned int i = 0; i < csp_conf.conn_max; i++) {
@@ -27,6 +27,10 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
 #include <csp/arch/csp_queue.h>
 #include <csp/arch/csp_semaphore.h>
 
+#include "csp_pqueue.h"
+#include "csp_aqm.h"
+#include "csp_timer.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -83,21 +87,30 @@ typedef struct {
 	csp_bin_sem_handle_t tx_wait;
 	csp_queue_handle_t tx_queue;
 	csp_queue_handle_t rx_queue;
+	csp_timer_t timer;		/**< Retransmit, delayed ACK and connection timeouts */
 } csp_rdp_t;
 
+/** Connection RX queue element */
+typedef struct {
+	csp_packet_t * packet;
+	uint32_t timestamp;		/* Time queued, only set if AQM is enabled */
+} csp_conn_rx_t;
+
 /** @brief Connection struct */
 struct csp_conn_s {
 	csp_conn_type_t type;		/* Connection type (CONN_CLIENT or CONN_SERVER) */
 	csp_conn_state_t state;		/* Connection state (CONN_OPEN or CONN_CLOSED) */
 	csp_id_t idin;			/* Identifier received */
 	csp_id_t idout;			/* Identifier transmitted */
-#if (CSP_USE_QOS)
-	csp_queue_handle_t rx_event;	/* Event queue for RX packets */
-#endif
-	csp_queue_handle_t rx_queue[CSP_RX_QUEUES]; /* Queue for RX packets */
+	csp_pqueue_t * rx_queue;	/* Queue for RX packets (csp_conn_rx_t), a level per RX queue (csp_conn_get_rxq()) */
+	csp_aqm_t aqm;			/* RX queue management and statistics */
 	csp_queue_handle_t socket;	/* Socket to be "woken" when first packet is ready */
 	uint32_t timestamp;		/* Time the connection was opened */
 	uint32_t opts;			/* Connection or socket options */
+	struct csp_conn_s * hash_next;	/* Next connection in lookup index bucket (open client connections only) */
+	uint8_t ephemeral;		/* Source port allocated by csp_connect() */
+	struct csp_poll_waiter_s * poll;	/* Task polling the connection or socket, see csp_poll() */
+	uint16_t free_next;		/* Next connection in the free list (index), while closed */
 #if (CSP_USE_RDP)
 	csp_rdp_t rdp;			/* RDP state */
 #endif
@@ -107,8 +120,8 @@ int csp_conn_enqueue_packet(csp_conn_t * conn, csp_packet_t * packet);
 int csp_conn_init(void);
 csp_conn_t * csp_conn_allocate(csp_conn_type_t type);
 csp_conn_t * csp_conn_find(uint32_t id, uint32_t mask);
+bool csp_conn_match(const csp_conn_t * conn, uint32_t id, uint32_t mask);
 csp_conn_t * csp_conn_new(csp_id_t idin, csp_id_t idout);
-void csp_conn_check_timeouts(void);
 int csp_conn_get_rxq(int prio);
 int csp_conn_close(csp_conn_t * conn, uint8_t closed_by);
 
@@ -83,7 +83,7 @@ int csp_crc32_append(csp_packet_t * packet, bool include_header) {
 
 	uint32_t crc;
 
-	if ((packet->length + sizeof(crc)) > csp_buffer_data_size()) {
+	if (csp_packet_tailroom(packet) < sizeof(crc)) {
 		return CSP_ERR_NOMEM;
 	}
 
@@ -97,8 +97,11 @@ int csp_crc32_append(csp_packet_t * packet, bool include_header) {
 	crc = csp_hton32(crc);
 
 	/* Copy checksum to packet */
-	memcpy(&packet->data[packet->length], &crc, sizeof(crc));
-	packet->length += sizeof(crc);
+	void * tail = csp_packet_put(packet, sizeof(crc));
+	if (tail == NULL) {
+		return CSP_ERR_NOMEM;
+	}
+	memcpy(tail, &crc, sizeof(crc));
 
 	return CSP_ERR_NONE;
 }
@@ -126,7 +129,7 @@ int csp_crc32_verify(csp_packet_t * packet, bool include_header) {
 	}
 
 	/* Strip CRC32 */
-	packet->length -= sizeof(crc);
+	csp_packet_trim(packet, sizeof(crc));
 	return CSP_ERR_NONE;
 }
 
@@ -23,6 +23,7 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
 #include "csp_dedup.h"
 
 #include <csp/arch/csp_time.h>
+#include <csp/arch/csp_malloc.h>
 #include <csp/csp_crc32.h>
 
 /* Check the last CSP_DEDUP_COUNT packets for duplicates */
@@ -31,31 +32,55 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
 /* Only consider packet a duplicate if received under CSP_DEDUP_WINDOW_MS ago */
 #define CSP_DEDUP_WINDOW_MS	(1000)
 
-/* Store packet CRC's in a ringbuffer */
-static uint32_t csp_dedup_array[CSP_DEDUP_COUNT] = {};
-static uint32_t csp_dedup_timestamp[CSP_DEDUP_COUNT] = {};
-static int csp_dedup_in = 0;
+/* Store packet CRC's in a ringbuffer, one per router shard (duplicates have the same id, so they end up in the same shard) */
+typedef struct {
+	uint32_t crc[CSP_DEDUP_COUNT];
+	uint32_t timestamp[CSP_DEDUP_COUNT];
+	int in;
+} csp_dedup_t;
 
-bool csp_dedup_is_duplicate(csp_packet_t *packet)
+static csp_dedup_t * csp_dedup;
+
+int csp_dedup_init(unsigned int shards) {
+
+	if (csp_dedup == NULL) {
+		csp_dedup = csp_calloc(shards, sizeof(*csp_dedup));
+		if (csp_dedup == NULL) {
+			return CSP_ERR_NOMEM;
+		}
+	}
+
+	return CSP_ERR_NONE;
+}
+
+void csp_dedup_free_resources(void) {
+
+	csp_free(csp_dedup);
+	csp_dedup = NULL;
+}
+
+bool csp_dedup_is_duplicate(unsigned int shard, csp_packet_t *packet)
 {
+	csp_dedup_t * dedup = &csp_dedup[shard];
+
 	/* Calculate CRC32 for packet */
 	uint32_t crc = csp_crc32_memory((const uint8_t *) &packet->id, packet->length + sizeof(packet->id));
 
 	/* Check if we have received this packet before */
 	for (int i = 0; i < CSP_DEDUP_COUNT; i++) {
 		/* Check for match */
-		if (crc == csp_dedup_array[i]) {
+		if (crc == dedup->crc[i]) {
 
 			/* Check the timestamp */
-			if (csp_get_ms() < csp_dedup_timestamp[i] + CSP_DEDUP_WINDOW_MS)
+			if (csp_get_ms() < dedup->timestamp[i] + CSP_DEDUP_WINDOW_MS)
 				return true;
 		}
 	}
 
 	/* If not, insert packet into duplicate list */
-	csp_dedup_array[csp_dedup_in] = crc;
-	csp_dedup_timestamp[csp_dedup_in] = csp_get_ms();
-	csp_dedup_in = (csp_dedup_in + 1) % CSP_DEDUP_COUNT;
+	dedup->crc[dedup->in] = crc;
+	dedup->timestamp[dedup->in] = csp_get_ms();
+	dedup->in = (dedup->in + 1) % CSP_DEDUP_COUNT;
 
 	return false;
 }
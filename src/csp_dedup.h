@@ -24,11 +24,21 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
 #include <stdbool.h>
 #include <csp/csp_types.h>
 
+/**
+ * Allocate duplicate history
+ * @param shards number of router shards, each shard has its own history
+ * @return CSP_ERR type
+ */
+int csp_dedup_init(unsigned int shards);
+
+void csp_dedup_free_resources(void);
+
 /**
  * Check for a duplicate packet
+ * @param shard router shard handling the packet
  * @param packet pointer to packet
  * @return false if not a duplicate, true if duplicate
  */
-bool csp_dedup_is_duplicate(csp_packet_t *packet);
+bool csp_dedup_is_duplicate(unsigned int shard, csp_packet_t *packet);
 
 #endif /* _CSP_DEDUP_H_ */
@@ -0,0 +1,100 @@
+/*
+Cubesat Space Protocol - A small network-layer protocol designed for Cubesats
+Copyright (C) 2012 GomSpace ApS (http://www.gomspace.com)
+Copyright (C) 2012 AAUSAT3 Project (http://aausat3.space.aau.dk)
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "csp_iface_tx.h"
+
+#include <csp/arch/csp_thread.h>
+
+#include "csp_pqueue.h"
+#include "csp_rate.h"
+
+/* Egress queue element */
+typedef struct {
+	csp_route_t route;
+	csp_packet_t * packet;
+	size_t bytes;
+} csp_iface_tx_t;
+
+static CSP_DEFINE_TASK(csp_iface_tx_task) {
+
+	csp_iface_t * iface = param;
+	csp_iface_tx_t tx;
+
+	while (1) {
+		if (csp_pqueue_dequeue(iface->tx_queue, &tx, CSP_MAX_TIMEOUT) != CSP_QUEUE_OK) {
+			continue;
+		}
+
+		/* Pace the queue at the interface and destination node rate limits (if any) */
+		csp_rate_shape(iface, tx.packet->id, tx.bytes);
+
+		if ((*iface->nexthop)(&tx.route, tx.packet) != CSP_ERR_NONE) {
+			iface->tx_error++;
+			csp_buffer_free(tx.packet);
+			continue;
+		}
+
+		iface->tx++;
+		iface->txbytes += tx.bytes;
+	}
+
+	csp_thread_exit();
+}
+
+int csp_iface_start_tx_task(csp_iface_t * iface, unsigned int queue_length, unsigned int task_stack_size, unsigned int task_priority) {
+
+	if ((iface == NULL) || (iface->nexthop == NULL) || (queue_length == 0)) {
+		return CSP_ERR_INVAL;
+	}
+
+	if (iface->tx_queue) {
+		return CSP_ERR_ALREADY;
+	}
+
+	csp_pqueue_t * tx_queue = csp_pqueue_create(CSP_PRIORITIES, queue_length, sizeof(csp_iface_tx_t));
+	if (tx_queue == NULL) {
+		return CSP_ERR_NOMEM;
+	}
+
+	iface->tx_queue = tx_queue;
+
+	int ret = csp_thread_create(csp_iface_tx_task, iface->name, task_stack_size, iface, task_priority, NULL);
+	if (ret != CSP_ERR_NONE) {
+		csp_log_error("Failed to start TX task for interface %s, error: %d", iface->name, ret);
+		iface->tx_queue = NULL;
+		csp_pqueue_remove(tx_queue);
+		return ret;
+	}
+
+	return CSP_ERR_NONE;
+}
+
+int csp_iface_tx_enqueue(const csp_route_t * ifroute, csp_packet_t * packet, size_t bytes) {
+
+	csp_iface_t * iface = ifroute->iface;
+	const csp_iface_tx_t tx = {.route = *ifroute, .packet = packet, .bytes = bytes};
+
+	if (csp_pqueue_enqueue(iface->tx_queue, packet->id.pri, &tx) != CSP_QUEUE_OK) {
+		iface->tx_queue_drop++;
+		return CSP_ERR_NOBUFS;
+	}
+
+	return CSP_ERR_NONE;
+}
@@ -0,0 +1,45 @@
+/*
+Cubesat Space Protocol - A small network-layer protocol designed for Cubesats
+Copyright (C) 2012 GomSpace ApS (http://www.gomspace.com)
+Copyright (C) 2012 AAUSAT3 Project (http://aausat3.space.aau.dk)
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef _CSP_IFACE_TX_H_
+#define _CSP_IFACE_TX_H_
+
+#include <csp/csp.h>
+#include <csp/csp_interface.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Queue packet for transmission by the interface's transmit task (see csp_iface_start_tx_task()).
+ * On success, the packet is owned (and freed) by the transmit task.
+ * @param ifroute route (interface and via address)
+ * @param packet packet, ready for the interface's next hop function
+ * @param bytes packet length, for the interface statistics
+ * @return CSP_ERR type
+ */
+int csp_iface_tx_enqueue(const csp_route_t * ifroute, csp_packet_t * packet, size_t bytes);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _CSP_IFACE_TX_H_ */
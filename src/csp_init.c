@@ -25,6 +25,10 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
 #include "csp_conn.h"
 #include "csp_qfifo.h"
 #include "csp_port.h"
+#include "csp_dedup.h"
+#include "csp_timer.h"
+#include "csp_rate.h"
+#include "csp_poll.h"
 
 #include <csp/interfaces/csp_if_lo.h>
 #include <csp/arch/csp_time.h>
@@ -43,6 +47,10 @@ int csp_init(const csp_conf_t * conf) {
 	 * unless specific get/set functions are made */
 	memcpy(&csp_conf, conf, sizeof(csp_conf));
 
+	if (csp_conf.router_workers == 0) {
+		csp_conf.router_workers = 1;
+	}
+
 	int ret = csp_buffer_init();
 	if (ret != CSP_ERR_NONE) {
 		return ret;
@@ -53,6 +61,11 @@ int csp_init(const csp_conf_t * conf) {
 		return ret;
 	}
 
+	ret = csp_poll_init();
+	if (ret != CSP_ERR_NONE) {
+		return ret;
+	}
+
 	ret = csp_port_init();
 	if (ret != CSP_ERR_NONE) {
 		return ret;
@@ -63,6 +76,20 @@ int csp_init(const csp_conf_t * conf) {
 		return ret;
 	}
 
+#if (CSP_USE_DEDUP)
+	ret = csp_dedup_init(csp_qfifo_shards());
+	if (ret != CSP_ERR_NONE) {
+		return ret;
+	}
+#endif
+
+#if (CSP_USE_RDP)
+	ret = csp_timer_init(csp_qfifo_shards());
+	if (ret != CSP_ERR_NONE) {
+		return ret;
+	}
+#endif
+
 	/* Loopback */
 	csp_iflist_add(&csp_if_lo);
 
@@ -78,7 +105,14 @@ int csp_init(const csp_conf_t * conf) {
 void csp_free_resources(void) {
 
 	csp_rtable_free();
+#if (CSP_USE_RDP)
+	csp_timer_free_resources();
+#endif
+#if (CSP_USE_DEDUP)
+	csp_dedup_free_resources();
+#endif
 	csp_qfifo_free_resources();
+	csp_rate_free_resources();
 	csp_port_free_resources();
 	csp_conn_free_resources();
 	csp_buffer_free_resources();
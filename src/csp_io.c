@@ -40,6 +40,8 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
 #include "csp_conn.h"
 #include "csp_promisc.h"
 #include "csp_qfifo.h"
+#include "csp_iface_tx.h"
+#include "csp_latency.h"
 #include "transport/csp_transport.h"
 
 #if (CSP_USE_PROMISC)
@@ -136,24 +138,23 @@ csp_packet_t * csp_read(csp_conn_t * conn, uint32_t timeout) {
 	}
 #endif
 
-#if (CSP_USE_QOS)
-	{
-		int event;
-		if (csp_queue_dequeue(conn->rx_event, &event, timeout) != CSP_QUEUE_OK) {
+	csp_conn_rx_t element;
+	while (1) {
+		if (csp_pqueue_dequeue(conn->rx_queue, &element, timeout) != CSP_QUEUE_OK) {
 			return NULL;
 		}
-
-		for (int prio = 0; prio < CSP_RX_QUEUES; prio++) {
-			if (csp_queue_dequeue(conn->rx_queue[prio], &packet, 0) == CSP_QUEUE_OK) {
-				break;
-			}
+		packet = element.packet;
+
+		/* Drop packets which have been queued for too long (not RDP, as received packets are already acknowledged) */
+		if ((packet != NULL) && csp_aqm_enabled() && !(conn->idin.flags & CSP_FRDP) &&
+			csp_aqm_dequeue(&conn->aqm, element.timestamp, csp_get_ms(), csp_pqueue_count(conn->rx_queue))) {
+			csp_buffer_free(packet);
+			/* AQM only drops if more packets are queued */
+			timeout = 0;
+			continue;
 		}
+		break;
 	}
-#else
-	if (csp_queue_dequeue(conn->rx_queue[0], &packet, timeout) != CSP_QUEUE_OK) {
-		return NULL;
-	}
-#endif
 
 #if (CSP_USE_RDP)
 	/* Packet read could trigger ACK transmission */
@@ -166,12 +167,37 @@ csp_packet_t * csp_read(csp_conn_t * conn, uint32_t timeout) {
 
 }
 
+/**
+ * Replace a packet with a copy (from csp_buffer_writable() or csp_packet_linearize()).
+ * The first replaced packet is returned in 'shared', as the caller's reference must be kept until the
+ * packet has been sent (the caller frees it on error). Intermediate copies are released.
+ */
+static int csp_io_replace(csp_packet_t ** packet, csp_packet_t ** shared, csp_packet_t * copy) {
+
+	if (copy == NULL) {
+		return CSP_ERR_NOMEM;
+	}
+
+	if (copy != *packet) {
+		if (*shared == NULL) {
+			*shared = *packet;
+		} else {
+			csp_buffer_free(*packet);
+		}
+		*packet = copy;
+	}
+
+	return CSP_ERR_NONE;
+}
+
 int csp_send_direct(csp_id_t idout, csp_packet_t * packet, const csp_route_t * ifroute, uint32_t timeout) {
 
 	(void) timeout;
-	uint16_t bytes;
+	const uint32_t start = csp_latency_start();
+	size_t bytes;
 	uint16_t mtu;
 	csp_iface_t * ifout;
+	csp_packet_t * shared = NULL;
 
 	if (packet == NULL) {
 		csp_log_error("csp_send_direct called with NULL packet");
@@ -188,19 +214,39 @@ int csp_send_direct(csp_id_t idout, csp_packet_t * packet, const csp_route_t * i
 	csp_log_packet("OUT: S %u, D %u, Dp %u, Sp %u, Pr %u, Fl 0x%02X, Sz %u VIA: %s (%u)",
 				idout.src, idout.dst, idout.dport, idout.sport, idout.pri, idout.flags, packet->length, ifout->name, (ifroute->via != CSP_NO_VIA_ADDRESS) ? ifroute->via : idout.dst);
 
+	/* Only encrypt packets from the current node */
+	const bool append = (idout.src == csp_conf.address) && (idout.flags & (CSP_FHMAC | CSP_FCRC32 | CSP_FXTEA));
+
+	/* Trailers are appended to a single buffer, and not all interfaces can send a chain of buffers */
+	if (csp_packet_next(packet) && (append || !ifout->chained)) {
+		if (csp_io_replace(&packet, &shared, csp_packet_linearize(packet)) != CSP_ERR_NONE) {
+			csp_log_warn("Failed to linearize chained packet, size %u", (unsigned int) csp_packet_chain_length(packet));
+			goto tx_err;
+		}
+	}
+
+	/* A shared buffer (e.g. queued for RDP retransmission) must not be modified, use a copy if needed */
+	if ((packet->id.ext != idout.ext) || append) {
+		if (csp_io_replace(&packet, &shared, csp_buffer_writable(packet)) != CSP_ERR_NONE) {
+			goto tx_err;
+		}
+	}
+
 	/* Copy identifier to packet (before crc, xtea and hmac) */
 	packet->id.ext = idout.ext;
 
 #if (CSP_USE_PROMISC)
 	/* Loopback traffic is added to promisc queue by the router */
 	if (idout.dst != csp_get_address() && idout.src == csp_get_address()) {
-		packet->id.ext = idout.ext;
 		csp_promisc_add(packet);
+		/* The promiscuous queue shares the packet, so it must be copied before appending */
+		if (append && (csp_io_replace(&packet, &shared, csp_buffer_writable(packet)) != CSP_ERR_NONE)) {
+			goto tx_err;
+		}
 	}
 #endif
 
-	/* Only encrypt packets from the current node */
-	if (idout.src == csp_conf.address) {
+	if (append) {
 		/* Append HMAC */
 		if (idout.flags & CSP_FHMAC) {
 #if (CSP_USE_HMAC)
@@ -247,22 +293,37 @@ int csp_send_direct(csp_id_t idout, csp_packet_t * packet, const csp_route_t * i
 	}
 
 	/* Store length before passing to interface */
-	bytes = packet->length;
+	bytes = csp_packet_chain_length(packet);
 	mtu = ifout->mtu;
 
 	if (mtu > 0 && bytes > mtu)
 		goto tx_err;
 
-	if ((*ifout->nexthop)(ifroute, packet) != CSP_ERR_NONE)
-		goto tx_err;
+	if (ifout->tx_queue) {
+		/* Transmitted (and counted) by the interface's transmit task */
+		if (csp_iface_tx_enqueue(ifroute, packet, bytes) != CSP_ERR_NONE)
+			goto tx_err;
+	} else {
+		if ((*ifout->nexthop)(ifroute, packet) != CSP_ERR_NONE)
+			goto tx_err;
 
-	ifout->tx++;
-	ifout->txbytes += bytes;
+		ifout->tx++;
+		ifout->txbytes += bytes;
+	}
+
+	/* Release the caller's reference, a copy was sent */
+	csp_buffer_free(shared);
+
+	csp_latency_record(CSP_ROUTE_STAGE_EGRESS, start);
 
 	return CSP_ERR_NONE;
 
 tx_err:
 	ifout->tx_error++;
+	if (shared) {
+		/* The caller frees its reference on error, free the copy */
+		csp_buffer_free(packet);
+	}
 err:
 	return CSP_ERR_TX;
 }
@@ -0,0 +1,112 @@
+/*
+Cubesat Space Protocol - A small network-layer protocol designed for Cubesats
+Copyright (C) 2012 GomSpace ApS (http://www.gomspace.com)
+Copyright (C) 2012 AAUSAT3 Project (http://aausat3.space.aau.dk)
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "csp_latency.h"
+
+#include <string.h>
+
+#if (CSP_USE_STATS)
+
+/* Histograms, updated by all router workers and sending tasks */
+static csp_latency_t latency[CSP_ROUTE_STAGES];
+
+/* Histogram bucket for a latency, 4 buckets per power of 2 */
+static unsigned int csp_latency_bucket(uint32_t ms) {
+
+	if (ms < 4) {
+		return ms;
+	}
+
+	const unsigned int msb = 31 - __builtin_clz(ms);
+	const unsigned int bucket = ((msb - 1) * 4) + ((ms >> (msb - 2)) & 3);
+
+	return (bucket < CSP_LATENCY_BUCKETS) ? bucket : (CSP_LATENCY_BUCKETS - 1);
+}
+
+void csp_latency_record(csp_route_stage_t stage, uint32_t start) {
+
+	csp_latency_t * hist = &latency[stage];
+	const uint32_t ms = csp_get_ms() - start;
+
+	__atomic_add_fetch(&hist->buckets[csp_latency_bucket(ms)], 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&hist->total, ms, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&hist->count, 1, __ATOMIC_RELAXED);
+
+	uint32_t max = __atomic_load_n(&hist->max, __ATOMIC_RELAXED);
+	while ((ms > max) && !__atomic_compare_exchange_n(&hist->max, &max, ms, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+#endif
+
+int csp_route_get_latency(csp_route_stage_t stage, csp_latency_t * hist) {
+
+#if (CSP_USE_STATS)
+	if ((stage >= CSP_ROUTE_STAGES) || (hist == NULL)) {
+		return CSP_ERR_INVAL;
+	}
+
+	/* Not a consistent snapshot, counters may be updated while copying */
+	for (unsigned int i = 0; i < CSP_LATENCY_BUCKETS; i++) {
+		hist->buckets[i] = __atomic_load_n(&latency[stage].buckets[i], __ATOMIC_RELAXED);
+	}
+	hist->count = __atomic_load_n(&latency[stage].count, __ATOMIC_RELAXED);
+	hist->total = __atomic_load_n(&latency[stage].total, __ATOMIC_RELAXED);
+	hist->max = __atomic_load_n(&latency[stage].max, __ATOMIC_RELAXED);
+
+	return CSP_ERR_NONE;
+#else
+	(void) stage;
+	(void) hist;
+	return CSP_ERR_NOTSUP;
+#endif
+}
+
+void csp_route_reset_latency(void) {
+
+#if (CSP_USE_STATS)
+	memset(latency, 0, sizeof(latency));
+#endif
+}
+
+uint32_t csp_latency_percentile(const csp_latency_t * hist, unsigned int permille) {
+
+	uint32_t total = 0;
+	for (unsigned int i = 0; i < CSP_LATENCY_BUCKETS; i++) {
+		total += hist->buckets[i];
+	}
+
+	const uint32_t rank = (uint32_t)(((uint64_t) total * permille + 999) / 1000);
+	uint32_t seen = 0;
+
+	for (unsigned int i = 0; i < CSP_LATENCY_BUCKETS; i++) {
+		seen += hist->buckets[i];
+		if ((seen >= rank) && (seen > 0)) {
+			if (i < 4) {
+				return i;
+			}
+			/* Upper bound of the bucket, but never more than the max seen */
+			const unsigned int shift = (i / 4) - 1;
+			const uint32_t upper = ((uint32_t)(4 + (i % 4) + 1) << shift) - 1;
+			return ((i == (CSP_LATENCY_BUCKETS - 1)) || (upper > hist->max)) ? hist->max : upper;
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,58 @@
+/*
+Cubesat Space Protocol - A small network-layer protocol designed for Cubesats
+Copyright (C) 2012 GomSpace ApS (http://www.gomspace.com)
+Copyright (C) 2012 AAUSAT3 Project (http://aausat3.space.aau.dk)
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef _CSP_LATENCY_H_
+#define _CSP_LATENCY_H_
+
+/**
+ * Router latency histograms (see csp_route_get_latency()), only recorded if compiled with CSP_USE_STATS.
+ */
+
+#include <csp/csp.h>
+#include <csp/arch/csp_time.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if (CSP_USE_STATS)
+
+/**
+ * Record latency for a router stage.
+ * @param stage router stage
+ * @param start start time of the stage (csp_get_ms())
+ */
+void csp_latency_record(csp_route_stage_t stage, uint32_t start);
+
+/** Start time of a stage, for csp_latency_record() */
+#define csp_latency_start()				csp_get_ms()
+
+#else
+
+#define csp_latency_record(stage, start)	do { (void) (start); } while (0)
+#define csp_latency_start()				0
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _CSP_LATENCY_H_ */
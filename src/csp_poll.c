@@ -0,0 +1,168 @@
+/*
+Cubesat Space Protocol - A small network-layer protocol designed for Cubesats
+Copyright (C) 2012 GomSpace ApS (http://www.gomspace.com)
+Copyright (C) 2012 AAUSAT3 Project (http://aausat3.space.aau.dk)
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "csp_poll.h"
+
+#include <csp/arch/csp_queue.h>
+#include <csp/arch/csp_semaphore.h>
+#include <csp/arch/csp_time.h>
+
+#include "csp_conn.h"
+#include "csp_promisc.h"
+
+struct csp_poll_waiter_s {
+	csp_bin_sem_handle_t wake;
+};
+
+/* Protects waiters while being woken up, so a waiter can't leave csp_poll() meanwhile */
+static csp_bin_sem_handle_t poll_lock;
+
+/* Task polling the promiscuous queue */
+static csp_poll_waiter_t * promisc_poll;
+
+int csp_poll_init(void) {
+
+	if (csp_bin_sem_create(&poll_lock) != CSP_SEMAPHORE_OK) {
+		csp_log_error("csp_bin_sem_create(&poll_lock) failed");
+		return CSP_ERR_NOMEM;
+	}
+
+	return CSP_ERR_NONE;
+}
+
+static void csp_poll_wake(csp_poll_waiter_t ** poll) {
+
+	/* Only lock, if polled */
+	if (__atomic_load_n(poll, __ATOMIC_ACQUIRE) == NULL) {
+		return;
+	}
+
+	if (csp_bin_sem_wait(&poll_lock, CSP_MAX_TIMEOUT) != CSP_SEMAPHORE_OK) {
+		return;
+	}
+
+	csp_poll_waiter_t * waiter = *poll;
+	if (waiter) {
+		csp_bin_sem_post(&waiter->wake);
+	}
+
+	csp_bin_sem_post(&poll_lock);
+}
+
+void csp_poll_notify(csp_conn_t * conn) {
+
+	csp_poll_wake(&conn->poll);
+}
+
+void csp_poll_notify_promisc(void) {
+
+	csp_poll_wake(&promisc_poll);
+}
+
+static csp_poll_waiter_t ** csp_poll_waiter(const csp_pollfd_t * fd) {
+
+	return fd->conn ? &fd->conn->poll : &promisc_poll;
+}
+
+static bool csp_poll_ready(const csp_pollfd_t * fd) {
+
+	const csp_conn_t * conn = fd->conn;
+
+	if (conn == NULL) {
+#if (CSP_USE_PROMISC)
+		return (csp_promisc_size() > 0);
+#else
+		return false;
+#endif
+	}
+
+	if (conn->type == CONN_SERVER) {
+		/* Listening socket (connections) or connection-less socket (packets) */
+		return (conn->socket && (csp_queue_size(conn->socket) > 0));
+	}
+
+	return (conn->rx_queue && (csp_pqueue_count(conn->rx_queue) > 0));
+}
+
+/* Set or clear waiter for the entries, returns number of entries set */
+static unsigned int csp_poll_register(csp_pollfd_t * fds, unsigned int count, csp_poll_waiter_t * waiter) {
+
+	unsigned int i;
+
+	csp_bin_sem_wait(&poll_lock, CSP_MAX_TIMEOUT);
+
+	for (i = 0; i < count; i++) {
+		csp_poll_waiter_t ** poll = csp_poll_waiter(&fds[i]);
+		if (waiter == NULL) {
+			__atomic_store_n(poll, NULL, __ATOMIC_RELEASE);
+		} else if ((*poll == NULL) || (*poll == waiter)) {
+			__atomic_store_n(poll, waiter, __ATOMIC_RELEASE);
+		} else {
+			/* Polled by another task */
+			break;
+		}
+	}
+
+	csp_bin_sem_post(&poll_lock);
+
+	return i;
+}
+
+int csp_poll(csp_pollfd_t * fds, unsigned int count, uint32_t timeout) {
+
+	if ((fds == NULL) && (count > 0)) {
+		return CSP_ERR_INVAL;
+	}
+
+	csp_poll_waiter_t waiter;
+	if (csp_bin_sem_create(&waiter.wake) != CSP_SEMAPHORE_OK) {
+		return CSP_ERR_NOMEM;
+	}
+	/* Ensure semaphore is busy, so the first wait blocks until woken */
+	csp_bin_sem_wait(&waiter.wake, 0);
+
+	/* Register before checking, so a packet queued after the check wakes us up */
+	const unsigned int registered = csp_poll_register(fds, count, &waiter);
+	int ready = CSP_ERR_BUSY;
+
+	if (registered == count) {
+		const uint32_t start = csp_get_ms();
+
+		while (1) {
+			ready = 0;
+			for (unsigned int i = 0; i < count; i++) {
+				fds[i].revents = csp_poll_ready(&fds[i]) ? CSP_POLLIN : 0;
+				ready += (fds[i].revents != 0);
+			}
+
+			const uint32_t elapsed = csp_get_ms() - start;
+			if (ready || (elapsed >= timeout)) {
+				break;
+			}
+
+			csp_bin_sem_wait(&waiter.wake, (timeout == CSP_MAX_TIMEOUT) ? CSP_MAX_TIMEOUT : (timeout - elapsed));
+		}
+	}
+
+	csp_poll_register(fds, registered, NULL);
+	csp_bin_sem_remove(&waiter.wake);
+
+	return ready;
+}
@@ -0,0 +1,58 @@
+/*
+Cubesat Space Protocol - A small network-layer protocol designed for Cubesats
+Copyright (C) 2012 GomSpace ApS (http://www.gomspace.com)
+Copyright (C) 2012 AAUSAT3 Project (http://aausat3.space.aau.dk)
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef _CSP_POLL_H_
+#define _CSP_POLL_H_
+
+/**
+ * Wake up of tasks waiting in csp_poll().
+ */
+
+#include <csp/csp.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Task waiting in csp_poll() */
+typedef struct csp_poll_waiter_s csp_poll_waiter_t;
+
+/**
+ * Initialize poll.
+ * @return CSP_ERR type
+ */
+int csp_poll_init(void);
+
+/**
+ * Wake up task polling the connection or socket (if any), after a packet or connection was queued.
+ * @param conn connection or socket
+ */
+void csp_poll_notify(csp_conn_t * conn);
+
+/**
+ * Wake up task polling the promiscuous queue (if any), after a packet was queued.
+ */
+void csp_poll_notify_promisc(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _CSP_POLL_H_ */
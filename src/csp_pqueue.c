@@ -0,0 +1,267 @@
+/*
+Cubesat Space Protocol - A small network-layer protocol designed for Cubesats
+Copyright (C) 2012 GomSpace ApS (http://www.gomspace.com)
+Copyright (C) 2012 AAUSAT3 Project (http://aausat3.space.aau.dk)
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "csp_pqueue.h"
+
+#include <stdint.h>
+
+#include <csp/arch/csp_malloc.h>
+#include <csp/arch/csp_time.h>
+
+struct csp_pqueue_s {
+	unsigned int levels;
+	size_t item_size;
+	uint32_t ready;				/* Bit per level, set when the level (may) hold items */
+	unsigned int waiting;			/* Number of readers waiting on wait */
+	csp_bin_sem_handle_t wait;		/* Signalled when an item is enqueued and readers are waiting */
+	csp_queue_handle_t queue[CSP_PRIORITIES];
+	/* Deficit round robin, see csp_pqueue_set_weights() */
+	uint32_t weighted;			/* Bit per level with a weight, other levels are strict priority */
+	uint8_t quantum[CSP_PRIORITIES];	/* Items per round */
+	uint8_t deficit[CSP_PRIORITIES];	/* Items left in current round */
+	unsigned int drr_level;			/* Level currently served */
+};
+
+csp_pqueue_t * csp_pqueue_create(unsigned int levels, int length, size_t item_size) {
+
+	if ((levels == 0) || (levels > CSP_PRIORITIES)) {
+		return NULL;
+	}
+
+	csp_pqueue_t * pqueue = csp_calloc(1, sizeof(*pqueue));
+	if (pqueue == NULL) {
+		return NULL;
+	}
+
+	pqueue->levels = levels;
+	pqueue->item_size = item_size;
+
+	if (levels > 1) {
+		if (csp_bin_sem_create(&pqueue->wait) != CSP_SEMAPHORE_OK) {
+			csp_free(pqueue);
+			return NULL;
+		}
+		/* Ensure semaphore is busy, so writers can release it */
+		csp_bin_sem_wait(&pqueue->wait, 0);
+	}
+
+	for (unsigned int level = 0; level < levels; level++) {
+		pqueue->queue[level] = csp_queue_create(length, item_size);
+		if (pqueue->queue[level] == NULL) {
+			csp_pqueue_remove(pqueue);
+			return NULL;
+		}
+	}
+
+	return pqueue;
+}
+
+void csp_pqueue_remove(csp_pqueue_t * pqueue) {
+
+	if (pqueue == NULL) {
+		return;
+	}
+
+	for (unsigned int level = 0; level < CSP_PRIORITIES; level++) {
+		if (pqueue->queue[level]) {
+			csp_queue_remove(pqueue->queue[level]);
+		}
+	}
+
+	if (pqueue->levels > 1) {
+		csp_bin_sem_remove(&pqueue->wait);
+	}
+
+	csp_free(pqueue);
+}
+
+int csp_pqueue_enqueue(csp_pqueue_t * pqueue, unsigned int level, const void * item) {
+
+	int result = csp_queue_enqueue(pqueue->queue[level], item, 0);
+
+	if ((result == CSP_QUEUE_OK) && (pqueue->levels > 1)) {
+		__atomic_fetch_or(&pqueue->ready, 1UL << level, __ATOMIC_SEQ_CST);
+		if (__atomic_load_n(&pqueue->waiting, __ATOMIC_SEQ_CST) > 0) {
+			csp_bin_sem_post(&pqueue->wait);
+		}
+	}
+
+	return result;
+}
+
+int csp_pqueue_enqueue_isr(csp_pqueue_t * pqueue, unsigned int level, const void * item, CSP_BASE_TYPE * pxTaskWoken) {
+
+	int result = csp_queue_enqueue_isr(pqueue->queue[level], item, pxTaskWoken);
+
+	if ((result == CSP_QUEUE_OK) && (pqueue->levels > 1)) {
+		__atomic_fetch_or(&pqueue->ready, 1UL << level, __ATOMIC_SEQ_CST);
+		if (__atomic_load_n(&pqueue->waiting, __ATOMIC_SEQ_CST) > 0) {
+			csp_bin_sem_post_isr(&pqueue->wait, pxTaskWoken);
+		}
+	}
+
+	return result;
+}
+
+void csp_pqueue_set_weights(csp_pqueue_t * pqueue, const uint8_t * weights) {
+
+	pqueue->weighted = 0;
+	pqueue->drr_level = 0;
+
+	for (unsigned int level = 0; level < pqueue->levels; level++) {
+		pqueue->quantum[level] = (weights != NULL) ? weights[level] : 0;
+		pqueue->deficit[level] = 0;
+		if (pqueue->quantum[level] > 0) {
+			pqueue->weighted |= (1UL << level);
+		}
+	}
+}
+
+/* Dequeue up to wanted items from a level, and clear its ready bit if emptied */
+static int csp_pqueue_take_level(csp_pqueue_t * pqueue, unsigned int level, void * items, int wanted) {
+
+	const int got = csp_queue_dequeue_bulk(pqueue->queue[level], items, wanted, 0);
+
+	if (got < wanted) {
+		/* Level is empty, unless a writer raced us - it then sets the bit again, or sees it set */
+		__atomic_fetch_and(&pqueue->ready, ~(1UL << level), __ATOMIC_SEQ_CST);
+		if (csp_queue_size(pqueue->queue[level]) > 0) {
+			__atomic_fetch_or(&pqueue->ready, 1UL << level, __ATOMIC_SEQ_CST);
+		}
+	}
+
+	return got;
+}
+
+/* Serve weighted levels round robin, each level up to its quantum per round */
+static int csp_pqueue_take_weighted(csp_pqueue_t * pqueue, void * items, int count) {
+
+	int found = 0;
+
+	while ((found < count) && (__atomic_load_n(&pqueue->ready, __ATOMIC_SEQ_CST) & pqueue->weighted)) {
+
+		const unsigned int level = pqueue->drr_level;
+
+		if ((pqueue->weighted & (1UL << level)) == 0) {
+			pqueue->drr_level = (level + 1) % pqueue->levels;
+			continue;
+		}
+
+		/* Start of the level's turn */
+		if (pqueue->deficit[level] == 0) {
+			pqueue->deficit[level] = pqueue->quantum[level];
+		}
+
+		const int wanted = ((count - found) < pqueue->deficit[level]) ? (count - found) : pqueue->deficit[level];
+		const int got = csp_pqueue_take_level(pqueue, level, (uint8_t *) items + (found * pqueue->item_size), wanted);
+		found += got;
+		pqueue->deficit[level] -= got;
+
+		/* Next level when the turn is used, or the level has no more items (loses the rest of its turn) */
+		if ((got < wanted) || (pqueue->deficit[level] == 0)) {
+			pqueue->deficit[level] = 0;
+			pqueue->drr_level = (level + 1) % pqueue->levels;
+		}
+	}
+
+	return found;
+}
+
+/* Dequeue available items, strict priority levels first (highest priority first), then weighted levels */
+static int csp_pqueue_take(csp_pqueue_t * pqueue, void * items, int count) {
+
+	int found = 0;
+	uint32_t ready = __atomic_load_n(&pqueue->ready, __ATOMIC_SEQ_CST) & ~pqueue->weighted;
+
+	while (ready && (found < count)) {
+		const unsigned int level = __builtin_ctz(ready);
+		ready &= ~(1UL << level);
+
+		found += csp_pqueue_take_level(pqueue, level, (uint8_t *) items + (found * pqueue->item_size), count - found);
+	}
+
+	if (pqueue->weighted && (found < count)) {
+		found += csp_pqueue_take_weighted(pqueue, (uint8_t *) items + (found * pqueue->item_size), count - found);
+	}
+
+	/* Pass the wake up on, if other readers are waiting for the remaining items */
+	if (found && __atomic_load_n(&pqueue->ready, __ATOMIC_SEQ_CST) && __atomic_load_n(&pqueue->waiting, __ATOMIC_SEQ_CST)) {
+		csp_bin_sem_post(&pqueue->wait);
+	}
+
+	return found;
+}
+
+int csp_pqueue_dequeue_bulk(csp_pqueue_t * pqueue, void * items, int count, uint32_t timeout) {
+
+	if (pqueue->levels == 1) {
+		return csp_queue_dequeue_bulk(pqueue->queue[0], items, count, timeout);
+	}
+
+	const uint32_t start = (timeout != CSP_MAX_TIMEOUT) ? csp_get_ms() : 0;
+
+	while (1) {
+		int found = csp_pqueue_take(pqueue, items, count);
+		if (found || (timeout == 0)) {
+			return found;
+		}
+
+		uint32_t remaining = CSP_MAX_TIMEOUT;
+		if (timeout != CSP_MAX_TIMEOUT) {
+			const uint32_t elapsed = csp_get_ms() - start;
+			if (elapsed >= timeout) {
+				return 0;
+			}
+			remaining = timeout - elapsed;
+		}
+
+		/* Announce the wait before checking again, so a writer either sees the waiter or we see its item */
+		__atomic_fetch_add(&pqueue->waiting, 1, __ATOMIC_SEQ_CST);
+		found = csp_pqueue_take(pqueue, items, count);
+		if (found == 0) {
+			csp_bin_sem_wait(&pqueue->wait, remaining);
+		}
+		__atomic_fetch_sub(&pqueue->waiting, 1, __ATOMIC_SEQ_CST);
+
+		if (found) {
+			return found;
+		}
+	}
+}
+
+int csp_pqueue_dequeue(csp_pqueue_t * pqueue, void * item, uint32_t timeout) {
+
+	return (csp_pqueue_dequeue_bulk(pqueue, item, 1, timeout) == 1) ? CSP_QUEUE_OK : CSP_QUEUE_ERROR;
+}
+
+int csp_pqueue_size(csp_pqueue_t * pqueue, unsigned int level) {
+
+	return csp_queue_size(pqueue->queue[level]);
+}
+
+int csp_pqueue_count(csp_pqueue_t * pqueue) {
+
+	int count = 0;
+	for (unsigned int level = 0; level < pqueue->levels; level++) {
+		count += csp_queue_size(pqueue->queue[level]);
+	}
+
+	return count;
+}
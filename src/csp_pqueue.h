@@ -0,0 +1,122 @@
+/*
+Cubesat Space Protocol - A small network-layer protocol designed for Cubesats
+Copyright (C) 2012 GomSpace ApS (http://www.gomspace.com)
+Copyright (C) 2012 AAUSAT3 Project (http://aausat3.space.aau.dk)
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef _CSP_PQUEUE_H_
+#define _CSP_PQUEUE_H_
+
+/**
+ * Multi-priority queue.
+ *
+ * One queue per priority level, a bitmap of levels holding items, and a single wait object.
+ * Items are dequeued highest priority (lowest level) first, or weighted, see csp_pqueue_set_weights(). A writer only signals the wait object
+ * when a reader is waiting, so enqueue/dequeue is a single queue operation per item.
+ * With one level, the queue is a plain csp_queue.
+ */
+
+#include <csp/arch/csp_queue.h>
+#include <csp/arch/csp_semaphore.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct csp_pqueue_s csp_pqueue_t;
+
+/**
+ * Create priority queue
+ * @param levels number of priority levels, 1 to #CSP_PRIORITIES
+ * @param length max number of items per level
+ * @param item_size size of an item
+ * @return queue, or NULL on failure
+ */
+csp_pqueue_t * csp_pqueue_create(unsigned int levels, int length, size_t item_size);
+
+void csp_pqueue_remove(csp_pqueue_t * pqueue);
+
+/**
+ * Set scheduling weights (deficit round robin).
+ * Levels with weight 0 are served in strict priority order before any weighted level. Levels with a weight
+ * share the remaining capacity round robin, each level dequeuing up to its weight in items per round.
+ * Without weights (default), all levels are served in strict priority order.
+ * Weighted scheduling keeps state between dequeues, and requires a single reader.
+ * @param pqueue queue
+ * @param weights weight per level, NULL to clear
+ */
+void csp_pqueue_set_weights(csp_pqueue_t * pqueue, const uint8_t * weights);
+
+/**
+ * Enqueue item, without waiting for room
+ * @param pqueue queue
+ * @param level priority level, 0 is the highest priority
+ * @param item item to copy into the queue
+ * @return #CSP_QUEUE_OK on success, #CSP_QUEUE_FULL if the level is full
+ */
+int csp_pqueue_enqueue(csp_pqueue_t * pqueue, unsigned int level, const void * item);
+
+/**
+ * Enqueue item from an ISR context
+ * @param pqueue queue
+ * @param level priority level, 0 is the highest priority
+ * @param item item to copy into the queue
+ * @param pxTaskWoken Valid reference if called from ISR, otherwise NULL!
+ * @return #CSP_QUEUE_OK on success, #CSP_QUEUE_FULL if the level is full
+ */
+int csp_pqueue_enqueue_isr(csp_pqueue_t * pqueue, unsigned int level, const void * item, CSP_BASE_TYPE * pxTaskWoken);
+
+/**
+ * Dequeue item with highest priority
+ * @param pqueue queue
+ * @param item buffer for the item
+ * @param timeout max time to wait for an item (ms)
+ * @return #CSP_QUEUE_OK on success, #CSP_QUEUE_ERROR on timeout
+ */
+int csp_pqueue_dequeue(csp_pqueue_t * pqueue, void * item, uint32_t timeout);
+
+/**
+ * Dequeue multiple items, highest priority first.
+ * Waits for the first item, and returns the items available.
+ * @param pqueue queue
+ * @param items buffer for the items, room for \a count items
+ * @param count max number of items
+ * @param timeout max time to wait for the first item (ms)
+ * @return number of items dequeued, 0 on timeout
+ */
+int csp_pqueue_dequeue_bulk(csp_pqueue_t * pqueue, void * items, int count, uint32_t timeout);
+
+/**
+ * Number of items in a priority level
+ * @param pqueue queue
+ * @param level priority level
+ * @return number of items
+ */
+int csp_pqueue_size(csp_pqueue_t * pqueue, unsigned int level);
+
+/**
+ * Number of items in all priority levels
+ * @param pqueue queue
+ * @return number of items
+ */
+int csp_pqueue_count(csp_pqueue_t * pqueue);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _CSP_PQUEUE_H_ */
@@ -21,6 +21,7 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
 #include <stdint.h>
 
 #include "csp_promisc.h"
+#include "csp_poll.h"
 
 #include <csp/csp.h>
 #include <csp/arch/csp_queue.h>
@@ -63,18 +64,25 @@ csp_packet_t * csp_promisc_read(uint32_t timeout) {
 	return packet;
 }
 
+int csp_promisc_size(void) {
+
+	return csp_promisc_queue ? csp_queue_size(csp_promisc_queue) : 0;
+}
+
 void csp_promisc_add(csp_packet_t * packet) {
 
 	if (csp_promisc_enabled == 0)
 		return;
 
 	if (csp_promisc_queue != NULL) {
-		/* Make a copy of the message and queue it to the promiscuous task */
-		csp_packet_t *packet_copy = csp_buffer_clone(packet);
+		/* Share the message with the promiscuous task, it must not be modified by either side */
+		csp_packet_t *packet_copy = csp_buffer_ref(packet);
 		if (packet_copy != NULL) {
 			if (csp_queue_enqueue(csp_promisc_queue, &packet_copy, 0) != CSP_QUEUE_OK) {
 				csp_log_error("Promiscuous mode input queue full");
 				csp_buffer_free(packet_copy);
+			} else {
+				csp_poll_notify_promisc();
 			}
 		}
 	}
@@ -33,6 +33,12 @@ extern "C" {
  */
 void csp_promisc_add(csp_packet_t * packet);
 
+/**
+ * Return number of packets in promiscuous mode packet queue
+ * @return number of packets
+ */
+int csp_promisc_size(void);
+
 #ifdef __cplusplus
 }
 #endif
@@ -19,87 +19,236 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
 */
 
 
+#include <csp/csp_iflist.h>
 #include <csp/arch/csp_queue.h>
+#include <csp/arch/csp_malloc.h>
+#include <csp/arch/csp_time.h>
 
 #include "csp_qfifo.h"
+#include "csp_pqueue.h"
+#include "csp_aqm.h"
 #include "csp_init.h"
+#include "csp_rate.h"
 
-static csp_queue_handle_t qfifo[CSP_ROUTE_FIFOS];
-#if (CSP_USE_QOS)
-static csp_queue_handle_t qfifo_events;
-#endif
+/* Router input queues, one per router worker/shard (with a level per priority) */
+typedef struct {
+	csp_pqueue_t * qfifo;
+	csp_aqm_t aqm;
+	csp_iface_t * poll_next;	/* Next interface RX queue to poll (round robin) */
+} csp_qfifo_shard_t;
+
+/* Interface RX queue (see csp_iface_set_rx_queue()), one per router worker/shard */
+typedef struct {
+	csp_queue_handle_t ring;
+	uint8_t scheduled;		/* Router is polling the queue, or has been woken up to do so */
+} csp_qfifo_rx_t;
+
+static csp_qfifo_shard_t * shards;
+static unsigned int shard_count;
 
 int csp_qfifo_init(void) {
 
-	/* Create router fifos for each priority */
-	for (int prio = 0; prio < CSP_ROUTE_FIFOS; prio++) {
-		if (qfifo[prio] == NULL) {
-			qfifo[prio] = csp_queue_create(csp_conf.fifo_length, sizeof(csp_qfifo_t));
-			if (!qfifo[prio])
-				return CSP_ERR_NOMEM;
+	if (shards == NULL) {
+		shard_count = (csp_conf.router_workers > 0) ? csp_conf.router_workers : 1;
+		shards = csp_calloc(shard_count, sizeof(*shards));
+		if (shards == NULL) {
+			return CSP_ERR_NOMEM;
 		}
 	}
 
+	for (unsigned int shard = 0; shard < shard_count; shard++) {
+
+		/* Create router fifo with a level for each priority */
+		if (shards[shard].qfifo == NULL) {
+			shards[shard].qfifo = csp_pqueue_create(CSP_ROUTE_FIFOS, csp_conf.fifo_length, sizeof(csp_qfifo_t));
+			if (!shards[shard].qfifo)
+				return CSP_ERR_NOMEM;
 #if (CSP_USE_QOS)
-	/* Create QoS fifo notification queue */
-	qfifo_events = csp_queue_create(csp_conf.fifo_length, sizeof(int));
-	if (!qfifo_events) {
-		return CSP_ERR_NOMEM;
-	}
+			csp_pqueue_set_weights(shards[shard].qfifo, csp_conf.fifo_weights);
 #endif
+		}
+	}
 
 	return CSP_ERR_NONE;
 }
 
 void csp_qfifo_free_resources(void) {
 
-	int prio;
+	if (shards == NULL) {
+		return;
+	}
+
+	for (unsigned int shard = 0; shard < shard_count; shard++) {
+		csp_pqueue_remove(shards[shard].qfifo);
+	}
 
-	for (prio = 0; prio < CSP_ROUTE_FIFOS; prio++) {
-		if (qfifo[prio]) {
-			csp_queue_remove(qfifo[prio]);
-			qfifo[prio] = NULL;
+	for (csp_iface_t * iface = csp_iflist_get(); iface != NULL; iface = iface->next) {
+		csp_qfifo_rx_t * rx = iface->rx_queue;
+		if (rx) {
+			for (unsigned int shard = 0; shard < shard_count; shard++) {
+				if (rx[shard].ring) {
+					csp_queue_remove(rx[shard].ring);
+				}
+			}
+			csp_free(rx);
+			iface->rx_queue = NULL;
 		}
 	}
 
-#if (CSP_USE_QOS)
-	if (qfifo_events) {
-		csp_queue_remove(qfifo_events);
-		qfifo_events = NULL;
+	csp_free(shards);
+	shards = NULL;
+	shard_count = 0;
+}
+
+unsigned int csp_qfifo_shards(void) {
+	return shard_count;
+}
+
+unsigned int csp_qfifo_shard(csp_id_t id) {
+
+	if (shard_count <= 1) {
+		return 0;
 	}
-#endif
+
+	/* Mix the connection tuple, so consecutive ports/addresses spread over the shards */
+	uint32_t hash = id.ext & CSP_ID_CONN_MASK;
+	hash ^= hash >> 16;
+	hash *= 0x45d9f3b;
+	hash ^= hash >> 16;
+
+	return hash % shard_count;
 }
 
-int csp_qfifo_read(csp_qfifo_t * input) {
+/* Release packets' share of the router queues (fifo_iface_max) */
+static inline void csp_qfifo_release(const csp_qfifo_t * input, int count) {
 
-#if (CSP_USE_QOS)
-	int prio, found, event;
+	if (csp_conf.fifo_iface_max == 0) {
+		return;
+	}
+
+	for (int i = 0; i < count; i++) {
+		if (input[i].packet) {
+			__atomic_sub_fetch(&input[i].iface->fifo_queued, 1, __ATOMIC_RELAXED);
+		}
+	}
+}
 
-	/* Wait for packet in any queue */
-	if (csp_queue_dequeue(qfifo_events, &event, FIFO_TIMEOUT) != CSP_QUEUE_OK)
-		return CSP_ERR_TIMEDOUT;
+/* Drop packets which have been queued for too long (AQM), returns the number of packets left */
+static int csp_qfifo_aqm(csp_qfifo_shard_t * q, csp_qfifo_t * input, int count) {
 
-	/* Find packet with highest priority */
-	found = 0;
-	for (prio = 0; prio < CSP_ROUTE_FIFOS; prio++) {
-		if (csp_queue_dequeue(qfifo[prio], input, 0) == CSP_QUEUE_OK) {
-			found = 1;
-			break;
+	const uint32_t now = csp_get_ms();
+	const int backlog = csp_pqueue_count(q->qfifo);
+	int kept = 0;
+
+	for (int i = 0; i < count; i++) {
+		if (input[i].packet && csp_aqm_dequeue(&q->aqm, input[i].timestamp, now, backlog + (count - i - 1))) {
+			input[i].iface->drop++;
+			csp_buffer_free(input[i].packet);
+			continue;
 		}
+		input[kept++] = input[i];
 	}
 
-	if (!found) {
-		csp_log_warn("Spurious wakeup: No packet found");
-		return CSP_ERR_TIMEDOUT;
+	return kept;
+}
+
+int csp_iface_set_rx_queue(csp_iface_t * iface, unsigned int length) {
+
+	if ((iface == NULL) || (length == 0) || (shards == NULL)) {
+		return CSP_ERR_INVAL;
 	}
-#else
-	if (csp_queue_dequeue(qfifo[0], input, FIFO_TIMEOUT) != CSP_QUEUE_OK)
-		return CSP_ERR_TIMEDOUT;
-#endif
+
+	if (iface->rx_queue) {
+		return CSP_ERR_ALREADY;
+	}
+
+	csp_qfifo_rx_t * rx = csp_calloc(shard_count, sizeof(*rx));
+	if (rx == NULL) {
+		return CSP_ERR_NOMEM;
+	}
+
+	for (unsigned int shard = 0; shard < shard_count; shard++) {
+		rx[shard].ring = csp_queue_create(length, sizeof(csp_qfifo_t));
+		if (rx[shard].ring == NULL) {
+			while (shard-- > 0) {
+				csp_queue_remove(rx[shard].ring);
+			}
+			csp_free(rx);
+			return CSP_ERR_NOMEM;
+		}
+	}
+
+	iface->rx_queue = rx;
 
 	return CSP_ERR_NONE;
 }
 
+/* Take packets from the interface RX queues scheduled for polling, round robin with a budget per interface */
+static int csp_qfifo_poll(unsigned int shard, csp_qfifo_t * input, int count) {
+
+	csp_qfifo_shard_t * q = &shards[shard];
+	csp_iface_t * start = q->poll_next ? q->poll_next : csp_iflist_get();
+	csp_iface_t * iface = start;
+	int found = 0;
+
+	while (iface && (found < count)) {
+
+		csp_qfifo_rx_t * rx = iface->rx_queue;
+		iface = iface->next ? iface->next : csp_iflist_get();
+
+		if (rx && __atomic_load_n(&rx[shard].scheduled, __ATOMIC_RELAXED)) {
+			const int wanted = ((count - found) < CSP_QFIFO_POLL_BUDGET) ? (count - found) : CSP_QFIFO_POLL_BUDGET;
+			const int got = csp_queue_dequeue_bulk(rx[shard].ring, &input[found], wanted, 0);
+			found += got;
+
+			if (got < wanted) {
+				/* Drained, back to wake ups - unless a packet arrived, while the writer saw the queue as scheduled.
+				   Then no wake up was posted for it, so post one, or the router may block with the packet queued */
+				__atomic_store_n(&rx[shard].scheduled, 0, __ATOMIC_SEQ_CST);
+				if ((csp_queue_size(rx[shard].ring) > 0) && (__atomic_exchange_n(&rx[shard].scheduled, 1, __ATOMIC_SEQ_CST) == 0)) {
+					csp_qfifo_wake_up_shard(shard);
+				}
+			}
+		}
+
+		if (iface == start) {
+			break;
+		}
+	}
+
+	q->poll_next = iface;
+
+	return found;
+}
+
+int csp_qfifo_read(unsigned int shard, csp_qfifo_t * input) {
+
+	return (csp_qfifo_read_bulk(shard, input, 1, FIFO_TIMEOUT) == 1) ? CSP_ERR_NONE : CSP_ERR_TIMEDOUT;
+}
+
+int csp_qfifo_read_bulk(unsigned int shard, csp_qfifo_t * input, int count, uint32_t timeout) {
+
+	csp_qfifo_shard_t * q = &shards[shard];
+
+	/* Busy interfaces are polled, and only block on the router queue when there is nothing to poll */
+	const int max = count;
+	const int polled = csp_qfifo_poll(shard, input, max);
+	const int queued = (polled < max) ? csp_pqueue_dequeue_bulk(q->qfifo, &input[polled], max - polled, (polled > 0) ? 0 : timeout) : 0;
+	csp_qfifo_release(&input[polled], queued);
+	count = polled + queued;
+
+	if ((polled == 0) && (count < max)) {
+		/* Woken up, possibly by an interface RX queue */
+		count += csp_qfifo_poll(shard, &input[count], max - count);
+	}
+
+	if (csp_aqm_enabled() && (count > 0)) {
+		count = csp_qfifo_aqm(q, input, count);
+	}
+
+	return count;
+}
+
 void csp_qfifo_write(csp_packet_t * packet, csp_iface_t * iface, CSP_BASE_TYPE * pxTaskWoken) {
 
 	int result;
@@ -122,9 +271,21 @@ void csp_qfifo_write(csp_packet_t * packet, csp_iface_t * iface, CSP_BASE_TYPE *
 		return;
 	}
 
+	/* Ingress policing, drop packets exceeding the interface's receive rate limit */
+	if (!csp_rate_police(iface, csp_packet_chain_length(packet), (pxTaskWoken != NULL))) {
+		if (pxTaskWoken == NULL)
+			csp_buffer_free(packet);
+		else
+			csp_buffer_free_isr(packet);
+		return;
+	}
+
 	csp_qfifo_t queue_element;
 	queue_element.iface = iface;
 	queue_element.packet = packet;
+	queue_element.timestamp = (csp_aqm_enabled() || CSP_USE_STATS) ? ((pxTaskWoken == NULL) ? csp_get_ms() : csp_get_ms_isr()) : 0;
+
+	csp_qfifo_shard_t * q = &shards[csp_qfifo_shard(packet->id)];
 
 #if (CSP_USE_QOS)
 	int fifo = packet->id.pri;
@@ -132,21 +293,41 @@ void csp_qfifo_write(csp_packet_t * packet, csp_iface_t * iface, CSP_BASE_TYPE *
 	int fifo = 0;
 #endif
 
-	if (pxTaskWoken == NULL)
-		result = csp_queue_enqueue(qfifo[fifo], &queue_element, 0);
-	else
-		result = csp_queue_enqueue_isr(qfifo[fifo], &queue_element, pxTaskWoken);
+	/* Drop counter, if the packet can't be queued */
+	uint32_t * drops = &q->aqm.stats.tail_drops;
+
+	csp_qfifo_rx_t * rx = iface->rx_queue;
+	if (rx) {
+		drops = &iface->rx_queue_drop;
+		rx = &rx[csp_qfifo_shard(packet->id)];
+		if (pxTaskWoken == NULL) {
+			result = csp_queue_enqueue(rx->ring, &queue_element, 0);
+		} else {
+			result = csp_queue_enqueue_isr(rx->ring, &queue_element, pxTaskWoken);
+		}
 
-#if (CSP_USE_QOS)
-	static int event = 0; // ?
+		/* Wake up the router, unless it is already polling the queue */
+		if ((result == CSP_QUEUE_OK) && (__atomic_exchange_n(&rx->scheduled, 1, __ATOMIC_SEQ_CST) == 0)) {
+			const csp_qfifo_t wake_element = {.iface = NULL, .packet = NULL, .timestamp = 0};
+			if (pxTaskWoken == NULL) {
+				csp_pqueue_enqueue(q->qfifo, 0, &wake_element);
+			} else {
+				csp_pqueue_enqueue_isr(q->qfifo, 0, &wake_element, pxTaskWoken);
+			}
+		}
+	} else if (csp_conf.fifo_iface_max && (__atomic_add_fetch(&iface->fifo_queued, 1, __ATOMIC_RELAXED) > csp_conf.fifo_iface_max)) {
+		/* Limit the share of the router queues a single interface can take */
+		result = CSP_QUEUE_FULL;
+		drops = &iface->fifo_drop;
+	} else if (pxTaskWoken == NULL) {
+		result = csp_pqueue_enqueue(q->qfifo, fifo, &queue_element);
+	} else {
+		result = csp_pqueue_enqueue_isr(q->qfifo, fifo, &queue_element, pxTaskWoken);
+	}
 
-	if (result == CSP_QUEUE_OK) {
-		if (pxTaskWoken == NULL)
-			csp_queue_enqueue(qfifo_events, &event, 0);
-		else
-			csp_queue_enqueue_isr(qfifo_events, &event, pxTaskWoken);
+	if ((result != CSP_QUEUE_OK) && csp_conf.fifo_iface_max && (rx == NULL)) {
+		__atomic_sub_fetch(&iface->fifo_queued, 1, __ATOMIC_RELAXED);
 	}
-#endif
 
 	if (result != CSP_QUEUE_OK) {
 		if (pxTaskWoken == NULL) { // Only do logging in non-ISR context
@@ -154,6 +335,8 @@ void csp_qfifo_write(csp_packet_t * packet, csp_iface_t * iface, CSP_BASE_TYPE *
 		}
 
 		iface->drop++;
+		/* Shared by all writers to the shard or interface, which may run on different threads */
+		__atomic_add_fetch(drops, 1, __ATOMIC_RELAXED);
 		
 		if (pxTaskWoken == NULL)
 			csp_buffer_free(packet);
@@ -163,6 +346,17 @@ void csp_qfifo_write(csp_packet_t * packet, csp_iface_t * iface, CSP_BASE_TYPE *
 }
 
 void csp_qfifo_wake_up(void) {
-	const csp_qfifo_t queue_element = {.iface = NULL, .packet = NULL};
-	csp_queue_enqueue(qfifo[0], &queue_element, 0);
+	const csp_qfifo_t queue_element = {.iface = NULL, .packet = NULL, .timestamp = 0};
+	for (unsigned int shard = 0; shard < shard_count; shard++) {
+		csp_pqueue_enqueue(shards[shard].qfifo, 0, &queue_element);
+	}
+}
+
+void csp_qfifo_wake_up_shard(unsigned int shard) {
+	const csp_qfifo_t queue_element = {.iface = NULL, .packet = NULL, .timestamp = 0};
+	csp_pqueue_enqueue(shards[shard].qfifo, 0, &queue_element);
+}
+
+void csp_qfifo_get_stats(unsigned int shard, csp_queue_stats_t * stats) {
+	*stats = shards[shard].aqm.stats;
 }
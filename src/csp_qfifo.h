@@ -21,13 +21,11 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
 #ifndef _CSP_QFIFO_H_
 #define _CSP_QFIFO_H_
 
+#include <csp/csp.h>
 #include <csp/csp_interface.h>
 
-#if (CSP_USE_RDP)
-#define FIFO_TIMEOUT 100			//! If RDP is enabled, the router needs to awake some times to check timeouts
-#else
-#define FIFO_TIMEOUT CSP_MAX_TIMEOUT		//! If no RDP, the router can sleep untill data arrives
-#endif
+#define FIFO_TIMEOUT CSP_MAX_TIMEOUT		//! Router sleeps until data arrives, or the next timer expires (csp_timer.h)
+#define CSP_QFIFO_POLL_BUDGET 8				//! Max packets taken from an interface RX queue per poll, before moving on to the next interface
 
 /**
  * Init FIFO/QOS queues
@@ -40,14 +38,40 @@ void csp_qfifo_free_resources(void);
 typedef struct {
 	csp_iface_t * iface;
 	csp_packet_t * packet;
+	uint32_t timestamp;	/* Time queued, only set if AQM or CSP_USE_STATS is enabled */
 } csp_qfifo_t;
 
+/**
+ * Number of router shards (router workers)
+ * @return number of shards, at least 1
+ */
+unsigned int csp_qfifo_shards(void);
+
+/**
+ * Router shard handling a connection
+ * @param id packet or connection (incoming) id, only the #CSP_ID_CONN_MASK part is used
+ * @return shard, 0 to csp_qfifo_shards() - 1
+ */
+unsigned int csp_qfifo_shard(csp_id_t id);
+
 /**
  * Read next packet from router input queue
+ * @param shard router shard to read from
  * @param input pointer to router queue item element
  * @return CSP_ERR type
  */
-int csp_qfifo_read(csp_qfifo_t * input);
+int csp_qfifo_read(unsigned int shard, csp_qfifo_t * input);
+
+/**
+ * Read multiple packets from router input queue, highest priority first.
+ * Waits for the first packet, and returns the packets available.
+ * @param shard router shard to read from
+ * @param input array of router queue item elements, room for \a count elements
+ * @param count max number of packets to read
+ * @param timeout max time to wait for the first packet (ms)
+ * @return number of packets read, 0 on timeout
+ */
+int csp_qfifo_read_bulk(unsigned int shard, csp_qfifo_t * input, int count, uint32_t timeout);
 
 /**
  * Wake up any task (e.g. router) waiting on messages.
@@ -55,4 +79,17 @@ int csp_qfifo_read(csp_qfifo_t * input);
  */
 void csp_qfifo_wake_up(void);
 
+/**
+ * Wake up the router worker of a shard, e.g. to re-calculate its timeout.
+ * @param shard router shard
+ */
+void csp_qfifo_wake_up_shard(unsigned int shard);
+
+/**
+ * Get router queue statistics
+ * @param shard router shard
+ * @param stats statistics
+ */
+void csp_qfifo_get_stats(unsigned int shard, csp_queue_stats_t * stats);
+
 #endif /* _CSP_QFIFO_H_ */
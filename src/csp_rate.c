@@ -0,0 +1,209 @@
+/*
+Cubesat Space Protocol - A small network-layer protocol designed for Cubesats
+Copyright (C) 2012 GomSpace ApS (http://www.gomspace.com)
+Copyright (C) 2012 AAUSAT3 Project (http://aausat3.space.aau.dk)
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "csp_rate.h"
+
+#include <csp/csp_iflist.h>
+#include <csp/arch/csp_malloc.h>
+#include <csp/arch/csp_thread.h>
+#include <csp/arch/csp_time.h>
+
+/* Bucket time resolution, 1/16 ms */
+#define CSP_RATE_TICKS_PER_MS	16
+
+/* Max time (ticks) a bucket can be reserved ahead, incl. the burst size - about 18 hours */
+#define CSP_RATE_AHEAD_MAX		(1UL << 30)
+
+/* A bucket not used for this long (ms) is full. Its empty time may have wrapped around, so it can't be compared to now */
+#define CSP_RATE_IDLE_MS		(CSP_RATE_AHEAD_MAX / CSP_RATE_TICKS_PER_MS)
+
+/* Token bucket */
+typedef struct {
+	uint32_t rate;			/* Bytes per second */
+	uint32_t tolerance;		/* Burst size, in ticks at rate */
+	uint32_t empty;			/* Time (ticks) when the bucket is full again, i.e. all reserved bytes sent */
+	uint32_t used;			/* Time (ms) of the last reservation */
+} csp_rate_t;
+
+/* Interface rate limits, stored in csp_iface_t.rate */
+typedef struct {
+	csp_rate_t tx;
+	csp_rate_t rx;
+} csp_rate_iface_t;
+
+/* Destination node rate limits, allocated when set */
+static csp_rate_t * node_rate[CSP_ID_HOST_MAX + 1];
+
+static void csp_rate_set(csp_rate_t * bucket, uint32_t rate, uint32_t burst) {
+
+	const uint64_t tolerance = rate ? (((uint64_t) burst * 1000 * CSP_RATE_TICKS_PER_MS) / rate) : 0;
+	bucket->tolerance = (tolerance < CSP_RATE_AHEAD_MAX) ? (uint32_t) tolerance : CSP_RATE_AHEAD_MAX;
+	bucket->rate = rate;
+}
+
+/**
+ * Reserve transmission time for a packet.
+ * @param bucket token bucket
+ * @param bytes packet length
+ * @param now_ms current time (ms)
+ * @param police only reserve, if the packet conforms
+ * @return ticks until the packet conforms (0 if conforming now)
+ */
+static uint32_t csp_rate_reserve(csp_rate_t * bucket, size_t bytes, uint32_t now_ms, bool police) {
+
+	const uint32_t rate = bucket->rate;
+	if (rate == 0) {
+		return 0;
+	}
+
+	const uint32_t now = now_ms * CSP_RATE_TICKS_PER_MS;
+	const uint64_t cost64 = ((uint64_t) bytes * 1000 * CSP_RATE_TICKS_PER_MS) / rate;
+	const uint32_t cost = (cost64 < CSP_RATE_AHEAD_MAX) ? (uint32_t) cost64 : CSP_RATE_AHEAD_MAX;
+	uint32_t empty = __atomic_load_n(&bucket->empty, __ATOMIC_RELAXED);
+	uint32_t ahead;
+	uint32_t wait;
+
+	do {
+		/* While in use, the empty time is within CSP_RATE_AHEAD_MAX of now, so the difference is exact */
+		const bool idle = ((uint32_t)(now_ms - __atomic_load_n(&bucket->used, __ATOMIC_ACQUIRE)) > CSP_RATE_IDLE_MS);
+		ahead = (!idle && ((int32_t)(empty - now) > 0)) ? (empty - now) : 0;
+
+		/* Packets up to the burst size are sent at once, the rest when enough tokens have been refilled */
+		wait = (ahead + cost > bucket->tolerance) ? (ahead + cost - bucket->tolerance) : 0;
+		if (police && wait) {
+			return wait;
+		}
+
+		/* Reservations further ahead are not tracked, the bucket must stay comparable to now */
+		if ((ahead + cost) > CSP_RATE_AHEAD_MAX) {
+			ahead = CSP_RATE_AHEAD_MAX - cost;
+		}
+	} while (!__atomic_compare_exchange_n(&bucket->empty, &empty, now + ahead + cost, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+	__atomic_store_n(&bucket->used, now_ms, __ATOMIC_RELEASE);
+
+	return wait;
+}
+
+int csp_iface_set_rate(csp_iface_t * iface, uint32_t tx_rate, uint32_t tx_burst, uint32_t rx_rate, uint32_t rx_burst) {
+
+	/* Packets are paced in the egress queue, never in the sending task */
+	if ((iface == NULL) || (tx_rate && (iface->tx_queue == NULL))) {
+		return CSP_ERR_INVAL;
+	}
+
+	csp_rate_iface_t * limits = iface->rate;
+	if (limits == NULL) {
+		if ((tx_rate == 0) && (rx_rate == 0)) {
+			return CSP_ERR_NONE;
+		}
+		limits = csp_calloc(1, sizeof(*limits));
+		if (limits == NULL) {
+			return CSP_ERR_NOMEM;
+		}
+	}
+
+	csp_rate_set(&limits->tx, tx_rate, tx_burst);
+	csp_rate_set(&limits->rx, rx_rate, rx_burst);
+	iface->rate = limits;
+
+	return CSP_ERR_NONE;
+}
+
+int csp_node_set_rate(uint8_t node, uint32_t rate, uint32_t burst) {
+
+	if (node > CSP_ID_HOST_MAX) {
+		return CSP_ERR_INVAL;
+	}
+
+	csp_rate_t * bucket = node_rate[node];
+	if (bucket == NULL) {
+		if (rate == 0) {
+			return CSP_ERR_NONE;
+		}
+		bucket = csp_calloc(1, sizeof(*bucket));
+		if (bucket == NULL) {
+			return CSP_ERR_NOMEM;
+		}
+	}
+
+	csp_rate_set(bucket, rate, burst);
+	node_rate[node] = bucket;
+
+	return CSP_ERR_NONE;
+}
+
+void csp_rate_shape(csp_iface_t * iface, csp_id_t id, size_t bytes) {
+
+	csp_rate_iface_t * limits = iface->rate;
+	csp_rate_t * node = node_rate[id.dst];
+
+	if ((limits == NULL) && (node == NULL)) {
+		return;
+	}
+
+	const uint32_t now = csp_get_ms();
+	uint32_t wait = 0;
+
+	if (limits) {
+		wait = csp_rate_reserve(&limits->tx, bytes, now, false);
+	}
+
+	if (node) {
+		const uint32_t node_wait = csp_rate_reserve(node, bytes, now, false);
+		if (node_wait > wait) {
+			wait = node_wait;
+		}
+	}
+
+	if (wait) {
+		csp_sleep_ms((wait + CSP_RATE_TICKS_PER_MS - 1) / CSP_RATE_TICKS_PER_MS);
+	}
+}
+
+bool csp_rate_police(csp_iface_t * iface, size_t bytes, bool isr) {
+
+	csp_rate_iface_t * limits = iface->rate;
+
+	if ((limits == NULL) || (limits->rx.rate == 0)) {
+		return true;
+	}
+
+	const uint32_t now = isr ? csp_get_ms_isr() : csp_get_ms();
+	if (csp_rate_reserve(&limits->rx, bytes, now, true)) {
+		iface->rx_policed++;
+		return false;
+	}
+
+	return true;
+}
+
+void csp_rate_free_resources(void) {
+
+	for (csp_iface_t * iface = csp_iflist_get(); iface != NULL; iface = iface->next) {
+		csp_free(iface->rate);
+		iface->rate = NULL;
+	}
+
+	for (unsigned int node = 0; node <= CSP_ID_HOST_MAX; node++) {
+		csp_free(node_rate[node]);
+		node_rate[node] = NULL;
+	}
+}
@@ -0,0 +1,68 @@
+/*
+Cubesat Space Protocol - A small network-layer protocol designed for Cubesats
+Copyright (C) 2012 GomSpace ApS (http://www.gomspace.com)
+Copyright (C) 2012 AAUSAT3 Project (http://aausat3.space.aau.dk)
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef _CSP_RATE_H_
+#define _CSP_RATE_H_
+
+/**
+ * Token bucket rate limits for interfaces and destination nodes (see csp_iface_set_rate() and csp_node_set_rate()).
+ *
+ * Implemented as a generic cell rate algorithm (GCRA): a bucket stores the time when it becomes empty again, and
+ * each packet moves that time forward by its transmission time at the configured rate.
+ */
+
+#include <stdbool.h>
+#include <csp/csp.h>
+#include <csp/csp_interface.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Wait until the packet may be sent on the interface, within the interface and destination node rate limits.
+ * The packet's transmission time is reserved in both buckets, so transmit tasks sharing a node limit are paced in turn.
+ * Only called by the interface's transmit task, see csp_iface_start_tx_task().
+ * @param iface outgoing interface
+ * @param id packet identifier (destination node)
+ * @param bytes packet length
+ */
+void csp_rate_shape(csp_iface_t * iface, csp_id_t id, size_t bytes);
+
+/**
+ * Check the interface ingress rate limit for a received packet.
+ * Non conforming packets are counted in #csp_iface_s.rx_policed, and must be dropped.
+ * @param iface incoming interface
+ * @param bytes packet length
+ * @param isr true if called from ISR
+ * @return true if the packet conforms to the rate limit
+ */
+bool csp_rate_police(csp_iface_t * iface, size_t bytes, bool isr);
+
+/**
+ * Free resources (rate limits of all interfaces and nodes).
+ */
+void csp_rate_free_resources(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _CSP_RATE_H_ */
@@ -38,8 +38,14 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
 #include "csp_promisc.h"
 #include "csp_qfifo.h"
 #include "csp_dedup.h"
+#include "csp_timer.h"
+#include "csp_latency.h"
+#include "csp_poll.h"
 #include "transport/csp_transport.h"
 
+/* Max number of packets routed per wakeup */
+#define CSP_ROUTE_BATCH 16
+
 /**
  * Check supported packet options
  * @param iface pointer to incoming interface
@@ -78,6 +84,13 @@ static int csp_route_check_options(csp_iface_t *iface, csp_packet_t *packet) {
 	}
 #endif
 
+	/* Trailers and the RDP header must be at the end of a single buffer */
+	if (csp_packet_next(packet) && (packet->id.flags & (CSP_FXTEA | CSP_FHMAC | CSP_FCRC32 | CSP_FRDP))) {
+		csp_log_error("Received chained packet with flags 0x%02X. Discarding packet", packet->id.flags);
+		iface->frame++;
+		return CSP_ERR_NOTSUP;
+	}
+
 	return CSP_ERR_NONE;
 }
 
@@ -88,7 +101,7 @@ static int csp_route_check_options(csp_iface_t *iface, csp_packet_t *packet) {
  * @param packet pointer to packet
  * @return #CSP_ERR_NONE on success, otherwise an error code.
  */
-static int csp_route_security_check(uint32_t security_opts, csp_iface_t * iface, csp_packet_t * packet) {
+static int csp_route_security_verify(uint32_t security_opts, csp_iface_t * iface, csp_packet_t * packet) {
 
 #if (CSP_USE_XTEA)
 	/* XTEA encrypted packet */
@@ -117,12 +130,11 @@ static int csp_route_security_check(uint32_t security_opts, csp_iface_t * iface,
 		}
 #else
 		/* No CRC32 validation - but size must be checked and adjusted */
-		if (packet->length < sizeof(uint32_t)) {
+		if (csp_packet_trim(packet, sizeof(uint32_t)) == NULL) {
 			csp_log_error("CRC32 verification error! Discarding packet");
 			iface->rx_error++;
 			return CSP_ERR_CRC32;
 		}
-		packet->length -= sizeof(uint32_t);
 #endif
 	} else if (security_opts & CSP_SO_CRC32REQ) {
 		csp_log_warn("Received packet with CRC32, but CSP was compiled without CRC32 support. Accepting packet");
@@ -159,34 +171,43 @@ static int csp_route_security_check(uint32_t security_opts, csp_iface_t * iface,
 	return CSP_ERR_NONE;
 }
 
-int csp_route_work(uint32_t timeout) {
+/**
+ * Decrypt, check auth and CRC32, and record the time spent
+ * @param security_opts either socket_opts or conn_opts
+ * @param iface pointer to incoming interface
+ * @param packet pointer to packet
+ * @return #CSP_ERR_NONE on success, otherwise an error code.
+ */
+static int csp_route_security_check(uint32_t security_opts, csp_iface_t * iface, csp_packet_t * packet) {
 
-	(void) timeout;
+	const uint32_t start = csp_latency_start();
+	const int ret = csp_route_security_verify(security_opts, iface, packet);
+	csp_latency_record(CSP_ROUTE_STAGE_SECURITY, start);
 
-	csp_qfifo_t input;
-	csp_packet_t * packet;
-	csp_conn_t * conn;
-	csp_socket_t * socket;
+	return ret;
+}
 
-#if (CSP_USE_RDP)
-	/* Check connection timeouts (currently only for RDP) */
-	csp_conn_check_timeouts();
-#endif
+/**
+ * Route a single packet from the router input queue
+ * @param shard router shard handling the packet
+ * @param input router queue element (packet and incoming interface)
+ * @param last_conn connection of the previous packet in the batch, updated with the connection of this packet
+ * @return CSP_ERR type
+ */
+static int csp_route_input(unsigned int shard, const csp_qfifo_t * input, csp_conn_t ** last_conn) {
 
-	/* Get next packet to route */
-	if (csp_qfifo_read(&input) != CSP_ERR_NONE) {
-		return CSP_ERR_TIMEDOUT;
-	}
+	csp_packet_t * packet = input->packet;
+	csp_conn_t * conn;
+	csp_socket_t * socket;
 
-	packet = input.packet;
+	(void) shard;
 
-	if (packet == NULL) {
-		return CSP_ERR_TIMEDOUT;
-	}
+	/* Time since csp_qfifo_write() */
+	csp_latency_record(CSP_ROUTE_STAGE_QUEUE, input->timestamp);
 
 	csp_log_packet("INP: S %u, D %u, Dp %u, Sp %u, Pr %u, Fl 0x%02X, Sz %" PRIu16 " VIA: %s",
 			packet->id.src, packet->id.dst, packet->id.dport,
-			packet->id.sport, packet->id.pri, packet->id.flags, packet->length, input.iface->name);
+			packet->id.sport, packet->id.pri, packet->id.flags, packet->length, input->iface->name);
 
 	/* Here there be promiscuous mode */
 #if (CSP_USE_PROMISC)
@@ -195,18 +216,18 @@ int csp_route_work(uint32_t timeout) {
 
 #if (CSP_USE_DEDUP)
 	/* Check for duplicates */
-	if (csp_dedup_is_duplicate(packet)) {
+	if (csp_dedup_is_duplicate(shard, packet)) {
 		/* Discard packet */
 		csp_log_packet("Duplicate packet discarded");
-		input.iface->drop++;
+		input->iface->drop++;
 		csp_buffer_free(packet);
 		return CSP_ERR_NONE;
 	}
 #endif
 
 	/* Now we count the message (since its deduplicated) */
-	input.iface->rx++;
-	input.iface->rxbytes += packet->length;
+	input->iface->rx++;
+	input->iface->rxbytes += packet->length;
 
 	/* If the message is not to me, route the message to the correct interface */
 	if ((packet->id.dst != csp_conf.address) && (packet->id.dst != CSP_BROADCAST_ADDR)) {
@@ -215,7 +236,7 @@ int csp_route_work(uint32_t timeout) {
 		const csp_route_t * ifroute = csp_rtable_find_route(packet->id.dst);
 
 		/* If the message resolves to the input interface, don't loop it back out */
-		if ((ifroute == NULL) || ((ifroute->iface == input.iface) && (input.iface->split_horizon_off == 0))) {
+		if ((ifroute == NULL) || ((ifroute->iface == input->iface) && (input->iface->split_horizon_off == 0))) {
 			csp_buffer_free(packet);
 			return CSP_ERR_NONE;
 		}
@@ -230,8 +251,24 @@ int csp_route_work(uint32_t timeout) {
 		return CSP_ERR_NONE;
 	}
 
+#if (CSP_USE_PROMISC)
+	/* The promiscuous queue may share the packet, get a private copy before it is verified, decrypted and delivered */
+	{
+		csp_packet_t * writable = csp_buffer_writable(packet);
+		if (writable == NULL) {
+			input->iface->drop++;
+			csp_buffer_free(packet);
+			return CSP_ERR_NONE;
+		}
+		if (writable != packet) {
+			csp_buffer_free(packet);
+			packet = writable;
+		}
+	}
+#endif
+
 	/* Discard packets with unsupported options */
-	if (csp_route_check_options(input.iface, packet) != CSP_ERR_NONE) {
+	if (csp_route_check_options(input->iface, packet) != CSP_ERR_NONE) {
 		csp_buffer_free(packet);
 		return CSP_ERR_NONE;
 	}
@@ -241,20 +278,26 @@ int csp_route_work(uint32_t timeout) {
 
 	/* If the socket is connection-less, deliver now */
 	if (socket && (socket->opts & CSP_SO_CONN_LESS)) {
-		if (csp_route_security_check(socket->opts, input.iface, packet) < 0) {
+		if (csp_route_security_check(socket->opts, input->iface, packet) < 0) {
 			csp_buffer_free(packet);
 			return CSP_ERR_NONE;
 		}
+		const uint32_t start = csp_latency_start();
 		if (csp_queue_enqueue(socket->socket, &packet, 0) != CSP_QUEUE_OK) {
 			csp_log_error("Conn-less socket queue full");
 			csp_buffer_free(packet);
 			return CSP_ERR_NONE;
 		}
+		csp_poll_notify(socket);
+		csp_latency_record(CSP_ROUTE_STAGE_DELIVERY, start);
 		return CSP_ERR_NONE;
 	}
 
-	/* Search for an existing connection */
-	conn = csp_conn_find(packet->id.ext, CSP_ID_CONN_MASK);
+	/* Search for an existing connection, packets in a burst usually belong to the same connection as the previous packet */
+	conn = *last_conn;
+	if ((conn == NULL) || !csp_conn_match(conn, packet->id.ext, CSP_ID_CONN_MASK)) {
+		conn = csp_conn_find(packet->id.ext, CSP_ID_CONN_MASK);
+	}
 
 	/* If this is an incoming packet on a new connection */
 	if (conn == NULL) {
@@ -265,7 +308,7 @@ int csp_route_work(uint32_t timeout) {
 		}
 
 		/* Run security check on incoming packet */
-		if (csp_route_security_check(socket->opts, input.iface, packet) < 0) {
+		if (csp_route_security_check(socket->opts, input->iface, packet) < 0) {
 			csp_buffer_free(packet);
 			return CSP_ERR_NONE;
 		}
@@ -296,36 +339,113 @@ int csp_route_work(uint32_t timeout) {
 	/* Packet to existing connection */
 	} else {
 		/* Run security check on incoming packet */
-		if (csp_route_security_check(conn->opts, input.iface, packet) < 0) {
+		if (csp_route_security_check(conn->opts, input->iface, packet) < 0) {
 			csp_buffer_free(packet);
 			return CSP_ERR_NONE;
 		}
 
 	}
 
+	*last_conn = conn;
+
+	const uint32_t start = csp_latency_start();
+
+	/* Connection not yet accepted (queued to the socket by the transport layer) */
+	const bool accept = (conn->socket != NULL) && (socket != NULL) && (conn->socket == socket->socket);
+
 #if (CSP_USE_RDP)
 	/* Pass packet to RDP module */
 	if (packet->id.flags & CSP_FRDP) {
+		/* Connection opened without RDP, e.g. an old connection still open when the port was reused */
+		if ((conn->idin.flags & CSP_FRDP) == 0) {
+			csp_log_warn("Received RDP packet on connection without RDP. Discarding packet");
+			input->iface->rx_error++;
+			csp_buffer_free(packet);
+			return CSP_ERR_NONE;
+		}
 		bool close_connection = csp_rdp_new_packet(conn, packet);
+		if (accept && (conn->socket == NULL)) {
+			csp_poll_notify(socket);
+		}
 		if (close_connection) {
 			csp_close(conn);
 		}
+		csp_latency_record(CSP_ROUTE_STAGE_DELIVERY, start);
 		return CSP_ERR_NONE;
 	}
 #endif
 
 	/* Pass packet to UDP module */
 	csp_udp_new_packet(conn, packet);
+	if (accept && (conn->socket == NULL)) {
+		csp_poll_notify(socket);
+	}
+	csp_latency_record(CSP_ROUTE_STAGE_DELIVERY, start);
+	return CSP_ERR_NONE;
+}
+
+int csp_route_work(uint32_t timeout) {
+
+	/* Packets of the other shards would never be routed */
+	if (csp_qfifo_shards() > 1) {
+		csp_log_error("csp_route_work() with %u router workers, use csp_route_work_shard()", csp_qfifo_shards());
+		return CSP_ERR_INVAL;
+	}
+
+	return csp_route_work_shard(0, timeout);
+}
+
+int csp_route_work_shard(unsigned int shard, uint32_t timeout) {
+
+	csp_qfifo_t input[CSP_ROUTE_BATCH];
+
+#if (CSP_USE_RDP)
+	/* Run expired connection timers (currently only RDP), and sleep no longer than until the next one */
+	csp_timer_run(shard);
+	const uint32_t next = csp_timer_next(shard);
+	if (next < timeout) {
+		timeout = next;
+	}
+#endif
+
+	/* Get next packets to route */
+	int count = csp_qfifo_read_bulk(shard, input, CSP_ROUTE_BATCH, timeout);
+	if (count <= 0) {
+		return CSP_ERR_TIMEDOUT;
+	}
+
+	csp_conn_t * last_conn = NULL;
+	int routed = 0;
+	for (int i = 0; i < count; i++) {
+		/* Skip wake up elements */
+		if (input[i].packet == NULL) {
+			continue;
+		}
+		csp_route_input(shard, &input[i], &last_conn);
+		routed++;
+	}
+
+	return (routed > 0) ? CSP_ERR_NONE : CSP_ERR_TIMEDOUT;
+}
+
+int csp_route_get_queue_stats(unsigned int shard, csp_queue_stats_t * stats) {
+
+	if ((shard >= csp_qfifo_shards()) || (stats == NULL)) {
+		return CSP_ERR_INVAL;
+	}
+
+	csp_qfifo_get_stats(shard, stats);
 	return CSP_ERR_NONE;
 }
 
 CSP_DEFINE_TASK(csp_task_router) {
 
-	(void) param;
+	/* Router shard is passed as parameter */
+	const unsigned int shard = (uintptr_t) param;
 
 	/* Here there be routing */
 	while (1) {
-		csp_route_work(FIFO_TIMEOUT);
+		csp_route_work_shard(shard, FIFO_TIMEOUT);
 	}
 
 	csp_thread_exit();
@@ -333,11 +453,13 @@ CSP_DEFINE_TASK(csp_task_router) {
 
 int csp_route_start_task(unsigned int task_stack_size, unsigned int task_priority) {
 
-	int ret = csp_thread_create(csp_task_router, "ROUTER", task_stack_size, NULL, task_priority, NULL);
+	for (unsigned int shard = 0; shard < csp_qfifo_shards(); shard++) {
+		int ret = csp_thread_create(csp_task_router, "ROUTER", task_stack_size, (void *) (uintptr_t) shard, task_priority, NULL);
 
-	if (ret != 0) {
-		csp_log_error("Failed to start router task, error: %d", ret);
-		return ret;
+		if (ret != 0) {
+			csp_log_error("Failed to start router task %u, error: %d", shard, ret);
+			return ret;
+		}
 	}
 
 	return CSP_ERR_NONE;
@@ -114,6 +114,25 @@ static int do_cmp_if_stats(struct csp_cmp_message *cmp) {
 	return CSP_ERR_NONE;
 }
 
+static int do_cmp_route_latency(struct csp_cmp_message *cmp) {
+
+	csp_latency_t latency;
+
+	int ret = csp_route_get_latency(cmp->route_latency.stage, &latency);
+	if (ret != CSP_ERR_NONE)
+		return ret;
+
+	cmp->route_latency.count = csp_hton32(latency.count);
+	cmp->route_latency.max =   csp_hton32(latency.max);
+	cmp->route_latency.mean =  csp_hton32(latency.count ? (latency.total / latency.count) : 0);
+	cmp->route_latency.p50 =   csp_hton32(csp_latency_percentile(&latency, 500));
+	cmp->route_latency.p90 =   csp_hton32(csp_latency_percentile(&latency, 900));
+	cmp->route_latency.p99 =   csp_hton32(csp_latency_percentile(&latency, 990));
+	cmp->route_latency.p999 =  csp_hton32(csp_latency_percentile(&latency, 999));
+
+	return CSP_ERR_NONE;
+}
+
 static int do_cmp_peek(struct csp_cmp_message *cmp) {
 
 	cmp->peek.addr = csp_hton32(cmp->peek.addr);
@@ -167,6 +186,29 @@ static int do_cmp_clock(struct csp_cmp_message *cmp) {
 	return res;
 }
 
+/**
+ * Ensure the request packet can hold a reply of 'size' bytes.
+ * With buffer size classes, the request may be in a buffer too small for the reply,
+ * in which case the packet is copied to a larger buffer.
+ * @return packet for the reply, or NULL if no buffer (request packet is freed)
+ */
+static csp_packet_t * csp_service_reply_packet(csp_packet_t * packet, size_t size) {
+
+	if (csp_buffer_data_size_of(packet) >= size) {
+		return packet;
+	}
+
+	csp_packet_t * reply = csp_buffer_get(size);
+	if (reply != NULL) {
+		reply->id = packet->id;
+		reply->length = packet->length;
+		memcpy(reply->data, packet->data, packet->length);
+	}
+
+	csp_buffer_free(packet);
+	return reply;
+}
+
 /* CSP Management Protocol handler */
 static int csp_cmp_handler(csp_conn_t * conn, csp_packet_t * packet) {
 
@@ -207,6 +249,11 @@ static int csp_cmp_handler(csp_conn_t * conn, csp_packet_t * packet) {
 			ret = do_cmp_clock(cmp);
 			break;
 
+		case CSP_CMP_ROUTE_LATENCY:
+			ret = do_cmp_route_latency(cmp);
+			packet->length = CMP_SIZE(route_latency);
+			break;
+
 		default:
 			ret = CSP_ERR_INVAL;
 			break;
@@ -222,6 +269,10 @@ void csp_service_handler(csp_conn_t * conn, csp_packet_t * packet) {
 	switch (csp_conn_dport(conn))
 	{
 	case CSP_CMP:
+		packet = csp_service_reply_packet(packet, sizeof(struct csp_cmp_message));
+		if (packet == NULL) {
+			return;
+		}
 		/* Pass to CMP handler */
 		if (csp_cmp_handler(conn, packet) != CSP_ERR_NONE) {
 			csp_buffer_free(packet);
@@ -243,6 +294,11 @@ void csp_service_handler(csp_conn_t * conn, csp_packet_t * packet) {
 			packet = NULL;
 			break;
 		}
+		/* The request packet is reused for the first reply */
+		packet = csp_service_reply_packet(packet, CSP_RPS_MTU);
+		if (packet == NULL) {
+			break;
+		}
 		/* Start by allocating just the right amount of memory */
 		char * pslist = csp_malloc(CSP_RPS_MTU);
 
@@ -296,6 +352,10 @@ void csp_service_handler(csp_conn_t * conn, csp_packet_t * packet) {
 	}
 
 	case CSP_MEMFREE: {
+		packet = csp_service_reply_packet(packet, sizeof(uint32_t));
+		if (packet == NULL) {
+			return;
+		}
 		uint32_t total = csp_sys_memfree();
 
 		total = csp_hton32(total);
@@ -323,6 +383,10 @@ void csp_service_handler(csp_conn_t * conn, csp_packet_t * packet) {
 	}
 
 	case CSP_BUF_FREE: {
+		packet = csp_service_reply_packet(packet, sizeof(uint32_t));
+		if (packet == NULL) {
+			return;
+		}
 		uint32_t size = csp_buffer_remaining();
 		size = csp_hton32(size);
 		memcpy(packet->data, &size, sizeof(size));
@@ -331,6 +395,10 @@ void csp_service_handler(csp_conn_t * conn, csp_packet_t * packet) {
 	}
 
 	case CSP_UPTIME: {
+		packet = csp_service_reply_packet(packet, sizeof(uint32_t));
+		if (packet == NULL) {
+			return;
+		}
 		uint32_t time = csp_get_uptime_s();
 		time = csp_hton32(time);
 		memcpy(packet->data, &time, sizeof(time));
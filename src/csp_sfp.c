@@ -43,9 +43,7 @@ typedef struct CSP_COMPILER_PACKED {
  */
 static inline sfp_header_t * csp_sfp_header_add(csp_packet_t * packet) {
 
-	sfp_header_t * header = (sfp_header_t *) &packet->data[packet->length];
-	packet->length += sizeof(*header);
-	return header;
+	return csp_packet_put(packet, sizeof(sfp_header_t));
 }
 
 static inline sfp_header_t * csp_sfp_header_remove(csp_packet_t * packet) {
@@ -54,14 +52,11 @@ static inline sfp_header_t * csp_sfp_header_remove(csp_packet_t * packet) {
 		return NULL;
 	}
 
-	sfp_header_t * header;
-	
-	if (packet->length < sizeof(*header)) {
+	sfp_header_t * header = csp_packet_trim(packet, sizeof(*header));
+
+	if (header == NULL) {
 		return NULL;
 	}
-	
-	header = (sfp_header_t *) &packet->data[packet->length - sizeof(*header)];
-	packet->length -= sizeof(*header);
 
 	header->offset = csp_ntoh32(header->offset);
 	header->totalsize = csp_ntoh32(header->totalsize);
@@ -130,22 +125,70 @@ int csp_sfp_send_own_memcpy(csp_conn_t * conn, const void * data, unsigned int t
 	return CSP_ERR_NONE;
 }
 
+/**
+ * Remove and check the SFP header of the next fragment of a transfer.
+ * @param packet fragment, freed on error
+ * @param data_offset expected offset (data received so far)
+ * @param totalsize total size of the transfer, set from the first fragment (\a data_offset 0)
+ * @return #CSP_ERR_NONE if the fragment is valid, otherwise an error.
+ */
+static int csp_sfp_fragment(csp_packet_t * packet, uint32_t data_offset, uint32_t * totalsize) {
+
+	/* Read SFP header */
+	sfp_header_t * sfp_header = csp_sfp_header_remove(packet);
+
+	if (sfp_header == NULL) {
+		csp_log_warn("%s: %u:%u, invalid message, id.flags: 0x%x, length: %u",
+					 __FUNCTION__, packet->id.src, packet->id.sport,
+					 packet->id.flags, packet->length);
+		csp_buffer_free(packet);
+		return CSP_ERR_SFP;
+	}
+
+	csp_log_protocol("%s: %u:%u, fragment %" PRIu32 "/%" PRIu32,
+					 __FUNCTION__, packet->id.src, packet->id.sport,
+					 sfp_header->offset + packet->length, sfp_header->totalsize);
+
+	/* Consistency check */
+	if (sfp_header->offset != data_offset) {
+		csp_log_warn("%s: %u:%u, invalid message, offset %" PRIu32 " (expected %" PRIu32 "), length: %u, totalsize %" PRIu32,
+					 __FUNCTION__, packet->id.src, packet->id.sport,
+					 sfp_header->offset, data_offset, packet->length, sfp_header->totalsize);
+		csp_buffer_free(packet);
+		return CSP_ERR_SFP;
+	}
+
+	if (data_offset == 0) {
+		*totalsize = sfp_header->totalsize;
+	}
+
+	/* Consistency check */
+	if (((data_offset + packet->length) > *totalsize) || (*totalsize != sfp_header->totalsize) ||
+		((packet->length == 0) && (data_offset < *totalsize))) {
+		csp_log_warn("%s: %u:%u, invalid size, sfp.offset: %" PRIu32 ", length: %u, total: %" PRIu32 " / %" PRIu32,
+					 __FUNCTION__, packet->id.src, packet->id.sport,
+					 sfp_header->offset, packet->length, *totalsize, sfp_header->totalsize);
+		csp_buffer_free(packet);
+		return CSP_ERR_SFP;
+	}
+
+	return CSP_ERR_NONE;
+}
+
+static csp_packet_t * csp_sfp_first(csp_conn_t * conn, uint32_t timeout, csp_packet_t * first_packet) {
+
+	/* Get first packet from user, or from connection */
+	return first_packet ? first_packet : csp_read(conn, timeout);
+}
+
 int csp_sfp_recv_fp(csp_conn_t * conn, void ** return_data, int * return_datasize, uint32_t timeout, csp_packet_t * first_packet) {
 
 	*return_data = NULL; /* Allow caller to assume csp_free() can always be called when dataout is non-NULL */
 	*return_datasize = 0;
 
-	/* Get first packet from user, or from connection */
-	csp_packet_t * packet;
-
-	if (first_packet == NULL) {
-		packet = csp_read(conn, timeout);
-	
-		if (packet == NULL) {
-			return CSP_ERR_TIMEDOUT;
-		}
-	} else {
-		packet = first_packet;
+	csp_packet_t * packet = csp_sfp_first(conn, timeout, first_packet);
+	if (packet == NULL) {
+		return CSP_ERR_TIMEDOUT;
 	}
 
 	uint8_t * data = NULL;
@@ -154,37 +197,13 @@ int csp_sfp_recv_fp(csp_conn_t * conn, void ** return_data, int * return_datasiz
 	int error = CSP_ERR_TIMEDOUT;
 
 	do {
-		/* Read SFP header */
-		sfp_header_t * sfp_header = csp_sfp_header_remove(packet);
-
-		if (sfp_header == NULL) {
-			csp_log_warn("%s: %u:%u, invalid message, id.flags: 0x%x, length: %u",
-						 __FUNCTION__, packet->id.src, packet->id.sport,
-						 packet->id.flags, packet->length);
-			csp_buffer_free(packet);
-
-			error = CSP_ERR_SFP;
-			goto error;
-		}
-
-		csp_log_protocol("%s: %u:%u, fragment %" PRIu32 "/%" PRIu32,
-						 __FUNCTION__, packet->id.src, packet->id.sport,
-						 sfp_header->offset + packet->length, sfp_header->totalsize);
-
-		/* Consistency check */
-		if (sfp_header->offset != data_offset) {
-			csp_log_warn("%s: %u:%u, invalid message, offset %" PRIu32 " (expected %" PRIu32 "), length: %u, totalsize %" PRIu32,
-						 __FUNCTION__, packet->id.src, packet->id.sport,
-						 sfp_header->offset, data_offset, packet->length, sfp_header->totalsize);
-			csp_buffer_free(packet);
-
-			error = CSP_ERR_SFP;
+		error = csp_sfp_fragment(packet, data_offset, &datasize);
+		if (error != CSP_ERR_NONE) {
 			goto error;
 		}
 
 		/* Allocate memory */
 		if (data == NULL) {
-			datasize = sfp_header->totalsize;
 			data = csp_malloc(datasize);
 
 			if (data == NULL) {
@@ -198,48 +217,70 @@ int csp_sfp_recv_fp(csp_conn_t * conn, void ** return_data, int * return_datasiz
 			}
 		}
 
-		/* Consistency check */
-		if (((data_offset + packet->length) > datasize) || (datasize != sfp_header->totalsize))
-		{
-			csp_log_warn("%s: %u:%u, invalid size, sfp.offset: %" PRIu32 ", length: %u, total: %" PRIu32 " / %" PRIu32,
-					__FUNCTION__, packet->id.src, packet->id.sport,
-					sfp_header->offset, packet->length, datasize, sfp_header->totalsize);
-			csp_buffer_free(packet);
-
-			error = CSP_ERR_SFP;
-			goto error;
-		}
-
 		/* Copy data to output */
 		memcpy(data + data_offset, packet->data, packet->length);
 		data_offset += packet->length;
+		csp_buffer_free(packet);
 
 		if (data_offset >= datasize) {
 			// transfer complete
-			csp_buffer_free(packet);
-						*return_data = data; // must be freed by csp_free()
-						*return_datasize = datasize;
+			*return_data = data; // must be freed by csp_free()
+			*return_datasize = datasize;
 
 			return CSP_ERR_NONE;
 		}
 
-		/* Consistency check */
-		if (packet->length == 0) {
-			csp_log_warn("%s: %u:%u, invalid size, sfp.offset: %" PRIu32 ", length: %u, total: %" PRIu32 " / %" PRIu32,
-					__FUNCTION__, packet->id.src, packet->id.sport,
-					sfp_header->offset, packet->length, datasize, sfp_header->totalsize);
+		error = CSP_ERR_TIMEDOUT;
 
-			csp_buffer_free(packet);
+	} while((packet = csp_read(conn, timeout)) != NULL);
+
+error:
+	csp_free(data);
+	return error;
+}
+
+int csp_sfp_recv_chain(csp_conn_t * conn, csp_packet_t ** return_packet, uint32_t timeout, csp_packet_t * first_packet) {
+
+	*return_packet = NULL;
+
+	csp_packet_t * packet = csp_sfp_first(conn, timeout, first_packet);
+	if (packet == NULL) {
+		return CSP_ERR_TIMEDOUT;
+	}
+
+	csp_packet_t * chain = NULL;
+	uint32_t datasize = 0;
+	uint32_t data_offset = 0;
+	int error;
+
+	do {
+		error = csp_sfp_fragment(packet, data_offset, &datasize);
+		if (error != CSP_ERR_NONE) {
+			break;
+		}
 
+		data_offset += packet->length;
+
+		/* The fragment is appended as is, the SFP header is already trimmed */
+		if (chain == NULL) {
+			chain = packet;
+		} else if (csp_packet_chain(chain, packet) != CSP_ERR_NONE) {
+			csp_buffer_free(packet);
 			error = CSP_ERR_SFP;
-			goto error;
+			break;
 		}
 
-		csp_buffer_free(packet);
+		if (data_offset >= datasize) {
+			// transfer complete
+			*return_packet = chain;
+
+			return CSP_ERR_NONE;
+		}
+
+		error = CSP_ERR_TIMEDOUT;
 
 	} while((packet = csp_read(conn, timeout)) != NULL);
 
-error:
-	csp_free(data);
-		return error;
+	csp_buffer_free(chain);
+	return error;
 }
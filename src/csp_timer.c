@@ -0,0 +1,314 @@
+/*
+Cubesat Space Protocol - A small network-layer protocol designed for Cubesats
+Copyright (C) 2012 GomSpace ApS (http://www.gomspace.com)
+Copyright (C) 2012 AAUSAT3 Project (http://aausat3.space.aau.dk)
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "csp_timer.h"
+
+#include <csp/arch/csp_malloc.h>
+#include <csp/arch/csp_semaphore.h>
+#include <csp/arch/csp_time.h>
+
+#include "csp_qfifo.h"
+
+/*
+ * Level 0 has 1 ms slots, each following level has slots covering a full round of the level below.
+ * Timers further away than the last level are placed in the last level, and re-placed when cascaded.
+ */
+#define TIMER_L0_BITS		8
+#define TIMER_LN_BITS		6
+#define TIMER_LEVELS		4
+#define TIMER_L0_SLOTS		(1 << TIMER_L0_BITS)
+#define TIMER_LN_SLOTS		(1 << TIMER_LN_BITS)
+#define TIMER_LEVEL_SHIFT(level) (TIMER_L0_BITS + ((level) - 1) * TIMER_LN_BITS)
+#define TIMER_MAX_DELTA		((1UL << TIMER_LEVEL_SHIFT(TIMER_LEVELS)) - 1)
+
+typedef struct {
+	csp_mutex_t lock;
+	uint32_t clock;				/* Next tick to process */
+	unsigned int armed;			/* Number of armed timers */
+	bool sleeping;				/* Router worker is waiting for packets */
+	uint32_t sleep_until;			/* Router worker wakes up at this time, if sleeping and armed > 0 */
+	csp_timer_t * l0[TIMER_L0_SLOTS];
+	csp_timer_t * ln[TIMER_LEVELS - 1][TIMER_LN_SLOTS];
+} csp_timer_wheel_t;
+
+static csp_timer_wheel_t * wheels;
+static unsigned int wheel_count;
+
+int csp_timer_init(unsigned int shards) {
+
+	if (wheels != NULL) {
+		return CSP_ERR_NONE;
+	}
+
+	wheels = csp_calloc(shards, sizeof(*wheels));
+	if (wheels == NULL) {
+		return CSP_ERR_NOMEM;
+	}
+
+	const uint32_t now = csp_get_ms();
+	for (wheel_count = 0; wheel_count < shards; wheel_count++) {
+		if (csp_mutex_create(&wheels[wheel_count].lock) != CSP_MUTEX_OK) {
+			csp_timer_free_resources();
+			return CSP_ERR_NOMEM;
+		}
+		wheels[wheel_count].clock = now;
+		wheels[wheel_count].sleeping = true;
+	}
+
+	return CSP_ERR_NONE;
+}
+
+void csp_timer_free_resources(void) {
+
+	if (wheels == NULL) {
+		return;
+	}
+
+	for (unsigned int i = 0; i < wheel_count; i++) {
+		csp_mutex_remove(&wheels[i].lock);
+	}
+
+	csp_free(wheels);
+	wheels = NULL;
+	wheel_count = 0;
+}
+
+void csp_timer_setup(csp_timer_t * timer, csp_timer_callback_t callback, void * arg) {
+
+	timer->next = NULL;
+	timer->pprev = NULL;
+	timer->expires = 0;
+	timer->shard = 0;
+	timer->callback = callback;
+	timer->arg = arg;
+}
+
+static inline void csp_timer_link(csp_timer_t ** slot, csp_timer_t * timer) {
+
+	timer->next = *slot;
+	if (timer->next) {
+		timer->next->pprev = &timer->next;
+	}
+	timer->pprev = slot;
+	*slot = timer;
+}
+
+static inline void csp_timer_unlink(csp_timer_t * timer) {
+
+	*timer->pprev = timer->next;
+	if (timer->next) {
+		timer->next->pprev = timer->pprev;
+	}
+	timer->next = NULL;
+	timer->pprev = NULL;
+}
+
+/* Place timer in the slot matching its expire time, relative to the wheel clock */
+static void csp_timer_place(csp_timer_wheel_t * wheel, csp_timer_t * timer) {
+
+	uint32_t expires = timer->expires;
+	int32_t delta = (int32_t) (expires - wheel->clock);
+
+	if (delta < 0) {
+		/* Already expired, run on next tick */
+		expires = wheel->clock;
+	} else if ((uint32_t) delta > TIMER_MAX_DELTA) {
+		expires = wheel->clock + TIMER_MAX_DELTA;
+	}
+
+	if ((expires - wheel->clock) < TIMER_L0_SLOTS) {
+		csp_timer_link(&wheel->l0[expires & (TIMER_L0_SLOTS - 1)], timer);
+		return;
+	}
+
+	int level = 1;
+	while ((level < (TIMER_LEVELS - 1)) && ((expires - wheel->clock) >= (1UL << TIMER_LEVEL_SHIFT(level + 1)))) {
+		level++;
+	}
+
+	csp_timer_link(&wheel->ln[level - 1][(expires >> TIMER_LEVEL_SHIFT(level)) & (TIMER_LN_SLOTS - 1)], timer);
+}
+
+/* Move all timers in a level 1+ slot to the levels below */
+static void csp_timer_cascade(csp_timer_wheel_t * wheel, int level) {
+
+	csp_timer_t ** slot = &wheel->ln[level - 1][(wheel->clock >> TIMER_LEVEL_SHIFT(level)) & (TIMER_LN_SLOTS - 1)];
+	csp_timer_t * timer = *slot;
+	*slot = NULL;
+
+	while (timer) {
+		csp_timer_t * next = timer->next;
+		csp_timer_place(wheel, timer);
+		timer = next;
+	}
+}
+
+/* Arm timer in a shard, takes the shard lock */
+static void csp_timer_arm_shard(unsigned int shard, csp_timer_t * timer, uint32_t expires, bool earlier) {
+
+	csp_timer_wheel_t * wheel = &wheels[shard];
+	bool wake = false;
+
+	/* Moving to another wheel */
+	if (timer->pprev && (timer->shard != shard)) {
+		csp_timer_cancel(timer);
+	}
+
+	csp_mutex_lock(&wheel->lock, CSP_MAX_TIMEOUT);
+
+	if (timer->pprev) {
+		if (earlier && ((int32_t) (timer->expires - expires) <= 0)) {
+			csp_mutex_unlock(&wheel->lock);
+			return;
+		}
+		csp_timer_unlink(timer);
+		wheel->armed--;
+	}
+
+	timer->expires = expires;
+	timer->shard = shard;
+	csp_timer_place(wheel, timer);
+
+	/* Wake up router worker, if it would sleep past the new timer */
+	if (wheel->sleeping && ((wheel->armed == 0) || ((int32_t) (expires - wheel->sleep_until) < 0))) {
+		wheel->sleeping = false;
+		wake = true;
+	}
+	wheel->armed++;
+
+	csp_mutex_unlock(&wheel->lock);
+
+	if (wake) {
+		csp_qfifo_wake_up_shard(shard);
+	}
+}
+
+void csp_timer_arm(unsigned int shard, csp_timer_t * timer, uint32_t expires) {
+
+	csp_timer_arm_shard(shard, timer, expires, false);
+}
+
+void csp_timer_arm_earlier(unsigned int shard, csp_timer_t * timer, uint32_t expires) {
+
+	csp_timer_arm_shard(shard, timer, expires, true);
+}
+
+void csp_timer_cancel(csp_timer_t * timer) {
+
+	csp_timer_wheel_t * wheel = &wheels[timer->shard];
+
+	csp_mutex_lock(&wheel->lock, CSP_MAX_TIMEOUT);
+	if (timer->pprev) {
+		csp_timer_unlink(timer);
+		wheel->armed--;
+	}
+	csp_mutex_unlock(&wheel->lock);
+}
+
+void csp_timer_run(unsigned int shard) {
+
+	csp_timer_wheel_t * wheel = &wheels[shard];
+	const uint32_t now = csp_get_ms();
+
+	csp_mutex_lock(&wheel->lock, CSP_MAX_TIMEOUT);
+
+	wheel->sleeping = false;
+
+	while ((int32_t) (now - wheel->clock) >= 0) {
+
+		if (wheel->armed == 0) {
+			wheel->clock = now + 1;
+			break;
+		}
+
+		/* Cascade higher levels, when the level below completes a round */
+		if ((wheel->clock & (TIMER_L0_SLOTS - 1)) == 0) {
+			int level = 1;
+			while ((level < (TIMER_LEVELS - 1)) && ((wheel->clock & ((1UL << TIMER_LEVEL_SHIFT(level + 1)) - 1)) == 0)) {
+				level++;
+			}
+			for (; level > 0; level--) {
+				csp_timer_cascade(wheel, level);
+			}
+		}
+
+		/* Detach expired timers, so they can be cancelled or re-armed while the lock is released */
+		csp_timer_t * expired = NULL;
+		csp_timer_t ** slot = &wheel->l0[wheel->clock & (TIMER_L0_SLOTS - 1)];
+		if (*slot) {
+			expired = *slot;
+			expired->pprev = &expired;
+			*slot = NULL;
+		}
+
+		const uint32_t tick = wheel->clock++;
+
+		while (expired) {
+			csp_timer_t * timer = expired;
+			csp_timer_unlink(timer);
+
+			/* Clamped timer, not expired yet */
+			if ((int32_t) (timer->expires - tick) > 0) {
+				csp_timer_place(wheel, timer);
+				continue;
+			}
+
+			wheel->armed--;
+
+			csp_mutex_unlock(&wheel->lock);
+			timer->callback(timer);
+			csp_mutex_lock(&wheel->lock, CSP_MAX_TIMEOUT);
+		}
+	}
+
+	csp_mutex_unlock(&wheel->lock);
+}
+
+uint32_t csp_timer_next(unsigned int shard) {
+
+	csp_timer_wheel_t * wheel = &wheels[shard];
+	uint32_t timeout = CSP_MAX_TIMEOUT;
+
+	csp_mutex_lock(&wheel->lock, CSP_MAX_TIMEOUT);
+
+	if (wheel->armed > 0) {
+		/* Next expire in level 0, or the next cascade (start of a level 0 round) */
+		uint32_t next = wheel->clock;
+		if (next & (TIMER_L0_SLOTS - 1)) {
+			next = (next | (TIMER_L0_SLOTS - 1)) + 1;
+		}
+		for (uint32_t tick = wheel->clock; tick != next; tick++) {
+			if (wheel->l0[tick & (TIMER_L0_SLOTS - 1)]) {
+				next = tick;
+				break;
+			}
+		}
+
+		const uint32_t now = csp_get_ms();
+		timeout = ((int32_t) (next - now) > 0) ? (next - now) : 0;
+		wheel->sleep_until = next;
+	}
+
+	wheel->sleeping = true;
+
+	csp_mutex_unlock(&wheel->lock);
+
+	return timeout;
+}
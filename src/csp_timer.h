@@ -0,0 +1,114 @@
+/*
+Cubesat Space Protocol - A small network-layer protocol designed for Cubesats
+Copyright (C) 2012 GomSpace ApS (http://www.gomspace.com)
+Copyright (C) 2012 AAUSAT3 Project (http://aausat3.space.aau.dk)
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef _CSP_TIMER_H_
+#define _CSP_TIMER_H_
+
+/**
+ * Hierarchical timer wheel, one wheel per router shard.
+ *
+ * Timers are armed, re-armed and cancelled in O(1). The router worker of a shard runs the expired timers
+ * by calling csp_timer_run(), and uses csp_timer_next() to sleep until the next timer expires.
+ * Timers may be armed from any task, the router worker is woken if the new timer expires before it
+ * would otherwise wake up.
+ */
+
+#include <stdbool.h>
+#include <csp/csp_types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct csp_timer_s csp_timer_t;
+
+/**
+ * Timer callback, called from the router worker of the shard the timer is armed in
+ * @param timer the expired timer, not armed when called (may be re-armed from the callback)
+ */
+typedef void (*csp_timer_callback_t)(csp_timer_t * timer);
+
+struct csp_timer_s {
+	csp_timer_t * next;		/* Next timer in slot */
+	csp_timer_t ** pprev;		/* Reference to this timer in slot, NULL if not armed */
+	uint32_t expires;		/* Expire time (ms, csp_get_ms()) */
+	unsigned int shard;		/* Shard (wheel) the timer is armed in */
+	csp_timer_callback_t callback;	/* Called on expire */
+	void * arg;			/* User argument */
+};
+
+/**
+ * Create a timer wheel for each router shard
+ * @param shards number of router shards
+ * @return CSP_ERR type
+ */
+int csp_timer_init(unsigned int shards);
+
+void csp_timer_free_resources(void);
+
+/**
+ * Setup timer (not armed)
+ * @param timer timer
+ * @param callback called when the timer expires
+ * @param arg user argument, available as timer->arg in the callback
+ */
+void csp_timer_setup(csp_timer_t * timer, csp_timer_callback_t callback, void * arg);
+
+/**
+ * Arm timer, or re-arm if already armed
+ * @param shard router shard (wheel) to arm the timer in
+ * @param timer timer
+ * @param expires expire time (ms, csp_get_ms()), may be in the past
+ */
+void csp_timer_arm(unsigned int shard, csp_timer_t * timer, uint32_t expires);
+
+/**
+ * Arm timer, unless it is already armed to expire before \a expires
+ * @param shard router shard (wheel) to arm the timer in
+ * @param timer timer
+ * @param expires expire time (ms, csp_get_ms()), may be in the past
+ */
+void csp_timer_arm_earlier(unsigned int shard, csp_timer_t * timer, uint32_t expires);
+
+/**
+ * Cancel timer, does nothing if the timer is not armed
+ * @param timer timer
+ */
+void csp_timer_cancel(csp_timer_t * timer);
+
+/**
+ * Run expired timers in a shard, must only be called from the router worker of the shard
+ * @param shard router shard
+ */
+void csp_timer_run(unsigned int shard);
+
+/**
+ * Time until the next timer in a shard expires, must only be called from the router worker of the shard.
+ * Timers armed to expire before this time will wake up the router worker.
+ * @param shard router shard
+ * @return time in ms, or #CSP_MAX_TIMEOUT if no timers are armed
+ */
+uint32_t csp_timer_next(unsigned int shard);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _CSP_TIMER_H_ */
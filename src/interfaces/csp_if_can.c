@@ -88,14 +88,32 @@ int csp_can_rx(csp_iface_t *iface, uint32_t id, const uint8_t *data, uint8_t dlc
 			break;
 		}
 
+		/* Get CSP length (of data) */
+		uint16_t length;
+		memcpy(&length, data + sizeof(csp_id_t), sizeof(length));
+		length = csp_ntoh16(length);
+
+		/* Check length against max */
+		if ((length > MAX_CAN_DATA_SIZE) || (length > csp_buffer_data_size())) {
+			iface->rx_error++;
+			csp_can_pbuf_free(buf, task_woken);
+			break;
+		}
+
 		/* Check for incomplete frame */
 		if (buf->packet != NULL) {
-			/* Reuse the buffer */
 			//csp_log_warn("Incomplete frame");
 			iface->frame++;
-		} else {
+			/* Reuse the buffer, if large enough */
+			if (csp_buffer_data_size_of(buf->packet) < length) {
+				task_woken ? csp_buffer_free_isr(buf->packet) : csp_buffer_free(buf->packet);
+				buf->packet = NULL;
+			}
+		}
+
+		if (buf->packet == NULL) {
 			/* Get free buffer for frame */
-			buf->packet = task_woken ? csp_buffer_get_isr(0) : csp_buffer_get(0); // CSP only supports one size
+			buf->packet = task_woken ? csp_buffer_get_isr(length) : csp_buffer_get(length);
 			if (buf->packet == NULL) {
 				//csp_log_error("Failed to get buffer for CSP_BEGIN packet");
 				iface->frame++;
@@ -108,16 +126,8 @@ int csp_can_rx(csp_iface_t *iface, uint32_t id, const uint8_t *data, uint8_t dlc
 		memcpy(&(buf->packet->id), data, sizeof(buf->packet->id));
 		buf->packet->id.ext = csp_ntoh32(buf->packet->id.ext);
 
-		/* Copy CSP length (of data) */
-		memcpy(&(buf->packet->length), data + sizeof(csp_id_t), sizeof(buf->packet->length));
-		buf->packet->length = csp_ntoh16(buf->packet->length);
-
-		/* Check length against max */
-		if ((buf->packet->length > MAX_CAN_DATA_SIZE) || (buf->packet->length > csp_buffer_data_size())) {
-			iface->rx_error++;
-			csp_can_pbuf_free(buf, task_woken);
-			break;
-		}
+		/* Set CSP length (of data) */
+		buf->packet->length = length;
 
 		/* Reset RX count */
 		buf->rx_count = 0;
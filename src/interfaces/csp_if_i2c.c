@@ -29,6 +29,13 @@ CSP_STATIC_ASSERT(offsetof(csp_i2c_frame_t, data) == offsetof(csp_packet_t, id),
 
 int csp_i2c_tx(const csp_route_t * ifroute, csp_packet_t * packet) {
 
+	/* The frame is built in the packet buffer, which cannot be shared */
+	csp_packet_t * shared = packet;
+	packet = csp_buffer_writable(packet);
+	if (packet == NULL) {
+		return CSP_ERR_NOMEM;
+	}
+
 	/* Cast the CSP packet buffer into an i2c frame */
 	csp_i2c_frame_t * frame = (csp_i2c_frame_t *) packet;
 
@@ -50,7 +57,14 @@ int csp_i2c_tx(const csp_route_t * ifroute, csp_packet_t * packet) {
 
 	/* send frame */
 	csp_i2c_interface_data_t * ifdata = ifroute->iface->interface_data;
-	return (ifdata->tx_func)(ifroute->iface->driver_data, frame);
+	int result = (ifdata->tx_func)(ifroute->iface->driver_data, frame);
+
+	if (packet != shared) {
+		/* Sent a copy: release the shared packet on success, otherwise the copy (caller frees the shared packet) */
+		csp_buffer_free((result == CSP_ERR_NONE) ? shared : packet);
+	}
+
+	return result;
 }
 
 /**
@@ -74,7 +88,7 @@ void csp_i2c_rx(csp_iface_t * iface, csp_i2c_frame_t * frame, void * pxTaskWoken
 	/* Strip the CSP header off the length field before converting to CSP packet */
 	frame->len -= sizeof(csp_id_t);
 
-	if (frame->len > csp_buffer_data_size()) { // consistency check, should never happen
+	if (frame->len > csp_buffer_data_size_of(frame)) { // consistency check, should never happen
 		iface->rx_error++;
 		(pxTaskWoken != NULL) ? csp_buffer_free_isr(frame) : csp_buffer_free(frame);
 		return;
@@ -37,14 +37,25 @@ int csp_kiss_tx(const csp_route_t * ifroute, csp_packet_t * packet) {
 	csp_kiss_interface_data_t * ifdata = ifroute->iface->interface_data;
 	void * driver = ifroute->iface->driver_data;
 
-	/* Add CRC32 checksum - the MTU setting ensures there are space */
-	csp_crc32_append(packet, false);
-
 	/* Lock */
 	if (csp_mutex_lock(&ifdata->lock, 1000) != CSP_MUTEX_OK) {
 		return CSP_ERR_TIMEDOUT;
 	}
 
+	/* CRC and header are added in the packet buffer, which cannot be shared */
+	csp_packet_t * writable = csp_buffer_writable(packet);
+	if (writable == NULL) {
+		csp_mutex_unlock(&ifdata->lock);
+		return CSP_ERR_NOMEM;
+	}
+	if (writable != packet) {
+		csp_buffer_free(packet);
+		packet = writable;
+	}
+
+	/* Add CRC32 checksum - the MTU setting ensures there are space */
+	csp_crc32_append(packet, false);
+
 	/* Save the outgoing id in the buffer */
 	packet->id.ext = csp_hton32(packet->id.ext);
 	packet->length += sizeof(packet->id.ext);
@@ -114,7 +125,7 @@ void csp_kiss_rx(csp_iface_t * iface, const uint8_t * buf, size_t len, void * px
 
 			/* Try to allocate new buffer */
 			if (ifdata->rx_packet == NULL) {
-				ifdata->rx_packet = pxTaskWoken ? csp_buffer_get_isr(0) : csp_buffer_get(0); // CSP only supports one size
+				ifdata->rx_packet = pxTaskWoken ? csp_buffer_get_isr(csp_buffer_data_size()) : csp_buffer_get(csp_buffer_data_size()); // frame length is unknown, use largest buffer
 			}
 
 			/* If no more memory, skip frame */
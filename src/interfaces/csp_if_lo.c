@@ -41,8 +41,17 @@ static int csp_lo_tx(const csp_route_t * ifroute, csp_packet_t * packet) {
 		return CSP_ERR_NONE;
 	}
 
+	/* The receiving side owns and modifies the packet, so it cannot be shared */
+	csp_packet_t * writable = csp_buffer_writable(packet);
+	if (writable == NULL) {
+		return CSP_ERR_NOMEM;
+	}
+	if (writable != packet) {
+		csp_buffer_free(packet);
+	}
+
 	/* Send back into CSP, notice calling from task so last argument must be NULL! */
-	csp_qfifo_write(packet, &csp_if_lo, NULL);
+	csp_qfifo_write(writable, &csp_if_lo, NULL);
 
 	return CSP_ERR_NONE;
 }
@@ -51,4 +60,5 @@ static int csp_lo_tx(const csp_route_t * ifroute, csp_packet_t * packet) {
 csp_iface_t csp_if_lo = {
 	.name = CSP_IF_LOOPBACK_NAME,
 	.nexthop = csp_lo_tx,
+	.chained = 1,
 };
@@ -48,6 +48,32 @@ typedef struct {
 	csp_iface_t iface;
 } zmq_driver_t;
 
+/**
+ * Transmit chained packet as a multi-part message, without copying the segments together.
+ * The first part holds the destination and id, each following part the data of one segment.
+ * @param packet Packet to transmit, not freed
+ * @return result of last zmq_send()
+ */
+static int csp_zmqhub_tx_chain(zmq_driver_t * drv, uint8_t dest, const csp_packet_t * packet)
+{
+	uint8_t header[sizeof(dest) + sizeof(packet->id)];
+	memcpy(header, &dest, sizeof(dest));
+	memcpy(header + sizeof(dest), &packet->id, sizeof(packet->id));
+
+	int result;
+	csp_bin_sem_wait(&drv->tx_wait, 1000); /* Using ZMQ in thread safe manner*/
+	{
+		/* Once the first part is queued, all parts must be sent to complete the message */
+		result = zmq_send(drv->publisher, header, sizeof(header), ZMQ_SNDMORE);
+		for (; packet && (result >= 0); packet = csp_packet_next(packet)) {
+			result = zmq_send(drv->publisher, packet->data, packet->length, csp_packet_next(packet) ? ZMQ_SNDMORE : 0);
+		}
+	}
+	csp_bin_sem_post(&drv->tx_wait); /* Release tx semaphore */
+
+	return result;
+}
+
 /**
  * Interface transmit function
  * @param packet Packet to transmit
@@ -59,20 +85,36 @@ static int csp_zmqhub_tx(const csp_route_t * route, csp_packet_t * packet)
 
 	int result;
 	const uint8_t dest = (route->via != CSP_NO_VIA_ADDRESS) ? route->via : packet->id.dst;
-	uint16_t length = packet->length;
-	uint8_t * destptr = ((uint8_t *) &packet->id) - sizeof(dest);
+	const uint16_t length = packet->length;
 
-	memcpy(destptr, &dest, sizeof(dest));
+	if (csp_packet_next(packet)) {
+		result = csp_zmqhub_tx_chain(drv, dest, packet);
+		if (result < 0) {
+			csp_log_error("ZMQ send error: %u %s\r\n", result, zmq_strerror(zmq_errno()));
+		}
+		csp_buffer_free(packet);
+		return CSP_ERR_NONE;
+	}
+
+	/* The destination is added in front of the id in the message, as the packet may be shared (e.g. RDP tx queue) */
+	zmq_msg_t msg;
+	if (zmq_msg_init_size(&msg, sizeof(dest) + sizeof(packet->id) + length) != 0) {
+		return CSP_ERR_NOMEM;
+	}
+
+	uint8_t * data = zmq_msg_data(&msg);
+	memcpy(data, &dest, sizeof(dest));
+	memcpy(data + sizeof(dest), &packet->id, sizeof(packet->id) + length);
 
 	csp_bin_sem_wait(&drv->tx_wait, 1000); /* Using ZMQ in thread safe manner*/
 	{
-		result = zmq_send(drv->publisher, destptr,
-						  length + sizeof(packet->id) + sizeof(dest), 0);
+		result = zmq_msg_send(&msg, drv->publisher, 0);
 	}
 	csp_bin_sem_post(&drv->tx_wait); /* Release tx semaphore */
 
 	if (result < 0) {
 		csp_log_error("ZMQ send error: %u %s\r\n", result, zmq_strerror(zmq_errno()));
+		zmq_msg_close(&msg);
 	}
 
 	csp_buffer_free(packet);
@@ -80,6 +122,63 @@ static int csp_zmqhub_tx(const csp_route_t * route, csp_packet_t * packet)
 	return CSP_ERR_NONE;
 }
 
+/**
+ * Receive the data parts of a multi-part (chained) message, see csp_zmqhub_tx_chain().
+ * The remaining parts are always received, also on error, so the next message starts with its first part.
+ * @param header first part (destination and id), NULL if invalid
+ * @return chained packet, or NULL on error
+ */
+static csp_packet_t * csp_zmqhub_rx_chain(zmq_driver_t * drv, const uint8_t * header)
+{
+	csp_packet_t * packet = NULL;
+	bool error = (header == NULL);
+	int more = 1;
+
+	while (more) {
+		zmq_msg_t msg;
+		zmq_msg_init(&msg);
+
+		if (zmq_msg_recv(&msg, drv->subscriber, 0) < 0) {
+			csp_log_error("RX %s: %s", drv->iface.name, zmq_strerror(zmq_errno()));
+			zmq_msg_close(&msg);
+			csp_buffer_free(packet);
+			return NULL;
+		}
+
+		more = zmq_msg_more(&msg);
+
+		const size_t datalen = zmq_msg_size(&msg);
+		if (!error && (datalen > 0)) {
+			csp_packet_t * segment = csp_buffer_get_chain(datalen);
+			if (segment) {
+				const uint8_t * rx_data = zmq_msg_data(&msg);
+				for (csp_packet_t * seg = segment; seg; seg = csp_packet_next(seg)) {
+					memcpy(seg->data, rx_data, seg->length);
+					rx_data += seg->length;
+				}
+				if (packet == NULL) {
+					packet = segment;
+					memcpy(&packet->id, header + sizeof(uint8_t), sizeof(packet->id));
+				} else {
+					csp_packet_chain(packet, segment);
+				}
+			} else {
+				csp_log_warn("RX %s: Failed to get csp_buffer chain(%u)", drv->iface.name, (unsigned int) datalen);
+				error = true;
+			}
+		}
+
+		zmq_msg_close(&msg);
+	}
+
+	if (error || (packet == NULL)) {
+		csp_buffer_free(packet);
+		return NULL;
+	}
+
+	return packet;
+}
+
 static CSP_DEFINE_TASK(csp_zmqhub_rx)
 {
 	zmq_driver_t * drv = param;
@@ -107,6 +206,41 @@ static CSP_DEFINE_TASK(csp_zmqhub_rx)
 			continue;
 		}
 
+		if (zmq_msg_more(&msg)) {
+			// Chained packet, the data follows in the next parts
+			if (datalen != HEADER_SIZE) {
+				csp_log_warn("ZMQ RX %s: Invalid chained packet header: %u bytes", drv->iface.name, datalen);
+			}
+			packet = csp_zmqhub_rx_chain(drv, (datalen == HEADER_SIZE) ? zmq_msg_data(&msg) : NULL);
+			if (packet) {
+				csp_qfifo_write(packet, &drv->iface, NULL);
+			}
+			zmq_msg_close(&msg);
+			continue;
+		}
+
+		if ((datalen - HEADER_SIZE) > csp_buffer_data_size()) {
+			// Too large for a single buffer, scatter the payload in a chained packet
+			packet = csp_buffer_get_chain(datalen - HEADER_SIZE);
+			if (packet == NULL) {
+				csp_log_warn("RX %s: Failed to get csp_buffer chain(%u)", drv->iface.name, datalen);
+				zmq_msg_close(&msg);
+				continue;
+			}
+
+			const uint8_t * rx_data = zmq_msg_data(&msg);
+			memcpy(&packet->id, rx_data + sizeof(uint8_t), sizeof(packet->id));
+			rx_data += HEADER_SIZE;
+			for (csp_packet_t * segment = packet; segment; segment = csp_packet_next(segment)) {
+				memcpy(segment->data, rx_data, segment->length);
+				rx_data += segment->length;
+			}
+
+			csp_qfifo_write(packet, &drv->iface, NULL);
+			zmq_msg_close(&msg);
+			continue;
+		}
+
 		// Create new csp packet
 		packet = csp_buffer_get(datalen - HEADER_SIZE);
 
@@ -116,16 +250,10 @@ static CSP_DEFINE_TASK(csp_zmqhub_rx)
 			continue;
 		}
 
-		// Copy the data from zmq to csp
-		const uint8_t * rx_data = zmq_msg_data(&msg);
-
-		// First byte is the "via" address
-		++rx_data;
-		--datalen;
-
-		// Remaining is CSP header and payload
-		memcpy(&packet->id, rx_data, datalen);
-		packet->length = (datalen - sizeof(packet->id));
+		// Copy the data from zmq to csp, first byte is the "via" address in front of the CSP header and payload
+		memcpy(csp_packet_push(packet, sizeof(uint8_t)), zmq_msg_data(&msg), datalen);
+		csp_packet_pull(packet, sizeof(uint8_t));
+		packet->length = (datalen - HEADER_SIZE);
 
 		// Route packet
 		csp_qfifo_write(packet, &drv->iface, NULL);
@@ -170,6 +298,8 @@ static int csp_zmqhub_init_w_name_endpoints_rxfilter(const char * ifname,
 	// there is actually no 'max' MTU on ZMQ,
 	// but assuming the other end is based on the same code
 	drv->iface.mtu = CSP_ZMQ_MTU;
+	// payloads larger than a buffer are sent and received as chained packets
+	drv->iface.chained = 1;
 
 	drv->context = zmq_ctx_new();
 	assert(drv->context);
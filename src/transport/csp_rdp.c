@@ -36,6 +36,7 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
 #include "../csp_conn.h"
 #include "../csp_io.h"
 #include "../csp_init.h"
+#include "../csp_qfifo.h"
 
 #include <csp/csp.h>
 #include <csp/csp_endian.h>
@@ -62,6 +63,9 @@ static uint32_t csp_rdp_ack_delay_count = 4 / 2;
 /* Used for queue calls */
 static CSP_BASE_TYPE pdTrue = 1;
 
+/* Number of queue elements moved/copied per queue operation, when looping through the RX/TX queues */
+#define RDP_QUEUE_BATCH 16
+
 /* RDP header - on top of csp_packet_t */
 typedef struct {
 	uint32_t quarantine;	// EACK quarantine period (-> csp_packet_t.padding)
@@ -102,6 +106,17 @@ typedef struct CSP_COMPILER_PACKED {
 
 static int csp_rdp_close_internal(csp_conn_t * conn, uint8_t closed_by, bool send_rst);
 
+/* Time between checks for room in the RX queues, when an ACK is held back */
+#define RDP_ACK_RECHECK_MS 10
+
+/**
+ * Ensure the connection timer expires no later than \a deadline.
+ * The timer runs in the router worker handling the connection's packets, see csp_rdp_check_timeouts().
+ */
+static inline void csp_rdp_timer_arm(csp_conn_t * conn, uint32_t deadline) {
+	csp_timer_arm_earlier(csp_qfifo_shard(conn->idin), &conn->rdp.timer, deadline);
+}
+
 /**
  * RDP Headers:
  * The following functions are helper functions that handles the extra RDP
@@ -109,22 +124,18 @@ static int csp_rdp_close_internal(csp_conn_t * conn, uint8_t closed_by, bool sen
  */
 static rdp_header_t * csp_rdp_header_add(csp_packet_t * packet) {
 
-	rdp_header_t * header;
+	rdp_header_t * header = csp_packet_put(packet, sizeof(*header));
 
-	if ((packet->length + sizeof(*header)) > csp_buffer_data_size()) {
+	if (header == NULL) {
 		return NULL;
 	}
 
-	header = (rdp_header_t *) &packet->data[packet->length];
-	packet->length += sizeof(*header);
 	memset(header, 0, sizeof(*header));
 	return header;
 }
 
 static rdp_header_t * csp_rdp_header_remove(csp_packet_t * packet) {
-	rdp_header_t * header = (rdp_header_t *) &packet->data[packet->length - sizeof(*header)];
-	packet->length -= sizeof(*header);
-	return header;
+	return csp_packet_trim(packet, sizeof(rdp_header_t));
 }
 
 static rdp_header_t * csp_rdp_header_ref(csp_packet_t * packet) {
@@ -195,10 +206,17 @@ static int csp_rdp_send_cmp(csp_conn_t * conn, csp_packet_t * packet, int flags,
 	header->syn = (flags & RDP_SYN) ? 1 : 0;
 	header->rst = (flags & RDP_RST) ? 1 : 0;
 
-	/* Send copy to tx_queue, before sending packet to IF */
+	/* Send control messages with high priority */
+	csp_id_t idout = conn->idout;
+	idout.pri = conn->idout.pri < CSP_PRIO_HIGH ? conn->idout.pri : CSP_PRIO_HIGH;
+
+	/* Share with tx_queue, before sending packet to IF */
 	if (flags & RDP_SYN) {
 
-		rdp_packet_t * rdp_packet = csp_buffer_clone(packet);
+		/* Set id now, so csp_send_direct() doesn't need to modify the shared packet */
+		packet->id.ext = idout.ext;
+
+		rdp_packet_t * rdp_packet = csp_buffer_ref(packet);
 
 		if (rdp_packet == NULL)
 			return CSP_ERR_NOMEM;
@@ -207,12 +225,10 @@ static int csp_rdp_send_cmp(csp_conn_t * conn, csp_packet_t * packet, int flags,
 
 		if (csp_queue_enqueue(conn->rdp.tx_queue, &rdp_packet, 0) != CSP_QUEUE_OK)
 			csp_buffer_free(rdp_packet);
+		else
+			csp_rdp_timer_arm(conn, rdp_packet->timestamp + conn->rdp.packet_timeout);
 	}
 
-	/* Send control messages with high priority */
-	csp_id_t idout = conn->idout;
-	idout.pri = conn->idout.pri < CSP_PRIO_HIGH ? conn->idout.pri : CSP_PRIO_HIGH;
-
 	csp_log_protocol("RDP %p: Send CMP S %u: syn %u, ack %u, eack %u, rst %u, seq_nr %5u, ack_nr %5u, packet_len %u (%u)",
 					 conn, conn->rdp.state, header->syn, header->ack, header->eak,
 					 header->rst, csp_ntoh16(header->seq_nr), csp_ntoh16(header->ack_nr),
@@ -248,25 +264,19 @@ static int csp_rdp_send_eack(csp_conn_t * conn) {
 
 	packet_eack->length = 0;
 
-	/* Loop through RX queue */
-	int i, count;
-	csp_packet_t * packet;
-	count = csp_queue_size(conn->rdp.rx_queue);
-
-	for (i = 0; i < count; i++) {
-		if (csp_queue_dequeue_isr(conn->rdp.rx_queue, &packet, &pdTrue) != CSP_QUEUE_OK) {
-			csp_log_error("RDP %p: Cannot dequeue from rx_queue in queue deliver", conn);
-			break;
+	/* Loop through RX queue, without removing the packets */
+	csp_packet_t * packets[RDP_QUEUE_BATCH];
+	int first = 0, count;
+
+	while ((count = csp_queue_peek_range(conn->rdp.rx_queue, packets, first, RDP_QUEUE_BATCH)) > 0) {
+		for (int i = 0; i < count; i++) {
+			/* Add seq nr to EACK packet */
+			rdp_header_t * header = csp_rdp_header_ref(packets[i]);
+			packet_eack->data16[packet_eack->length/sizeof(uint16_t)] = csp_hton16(header->seq_nr);
+			packet_eack->length += sizeof(uint16_t);
+			csp_log_protocol("RDP %p: Added EACK nr %u", conn, header->seq_nr);
 		}
-
-		/* Add seq nr to EACK packet */
-		rdp_header_t * header = csp_rdp_header_ref(packet);
-		packet_eack->data16[packet_eack->length/sizeof(uint16_t)] = csp_hton16(header->seq_nr);
-		packet_eack->length += sizeof(uint16_t);
-		csp_log_protocol("RDP %p: Added EACK nr %u", conn, header->seq_nr);
-
-		/* Requeue */
-		csp_queue_enqueue_isr(conn->rdp.rx_queue, &packet, &pdTrue);
+		first += count;
 	}
 
 	return csp_rdp_send_cmp(conn, packet_eack, RDP_ACK | RDP_EAK,
@@ -314,63 +324,67 @@ static inline int csp_rdp_receive_data(csp_conn_t * conn, csp_packet_t * packet)
 
 static inline void csp_rdp_rx_queue_flush(csp_conn_t * conn) {
 
-	/* Loop through RX queue */
-	int i, count;
-	csp_packet_t * packet;
-
-	count = csp_queue_size(conn->rdp.rx_queue);
-
-	for (i = 0; i < count; i++) {
-		if (csp_queue_dequeue_isr(conn->rdp.rx_queue, &packet, &pdTrue) != CSP_QUEUE_OK) {
-			csp_log_error("RDP %p: Cannot dequeue from rx_queue in queue deliver", conn);
-			break;
-		}
+	csp_packet_t * packets[RDP_QUEUE_BATCH];
+	bool delivered;
 
-		rdp_header_t * header = csp_rdp_header_ref(packet);
-		csp_log_protocol("RDP %p: RX Queue deliver matching Element, seq %u", conn, header->seq_nr);
+	/* Loop through RX queue, until a pass delivers nothing */
+	do {
+		delivered = false;
 
-		/* If the matching packet was found: */
-		if (header->seq_nr == (uint16_t)(conn->rdp.rcv_cur + 1))
-		{
-			csp_log_protocol("RDP %p: Deliver seq %u", conn, header->seq_nr);
-			csp_rdp_receive_data(conn, packet);
-			conn->rdp.rcv_cur++;
+		/* Requeued packets go to the back, so only visit the packets present at the start of the pass */
+		int remaining = csp_queue_size(conn->rdp.rx_queue);
 
-			/* reset to initial state and start the loop over */
-			i = 0;
-			count = csp_queue_size(conn->rdp.rx_queue);
-			continue;
+		while (remaining > 0) {
+			int count = csp_queue_dequeue_bulk(conn->rdp.rx_queue, packets, (remaining < RDP_QUEUE_BATCH) ? remaining : RDP_QUEUE_BATCH, 0);
+			if (count == 0) {
+				csp_log_error("RDP %p: Cannot dequeue from rx_queue in queue deliver", conn);
+				return;
+			}
+			remaining -= count;
+
+			int kept = 0;
+			for (int i = 0; i < count; i++) {
+				rdp_header_t * header = csp_rdp_header_ref(packets[i]);
+				csp_log_protocol("RDP %p: RX Queue deliver matching Element, seq %u", conn, header->seq_nr);
+
+				/* If the matching packet was found: */
+				if (header->seq_nr == (uint16_t)(conn->rdp.rcv_cur + 1)) {
+					csp_log_protocol("RDP %p: Deliver seq %u", conn, header->seq_nr);
+					csp_rdp_receive_data(conn, packets[i]);
+					conn->rdp.rcv_cur++;
+					delivered = true;
+
+				/* Otherwise, requeue */
+				} else {
+					packets[kept++] = packets[i];
+				}
+			}
 
-		/* Otherwise, requeue */
-		} else {
-			csp_queue_enqueue_isr(conn->rdp.rx_queue, &packet, &pdTrue);
+			if (kept > 0) {
+				csp_queue_enqueue_bulk(conn->rdp.rx_queue, packets, kept, 0);
+			}
 		}
-	}
+	} while (delivered);
 }
 
 static inline bool csp_rdp_seq_in_rx_queue(csp_conn_t * conn, uint16_t seq_nr) {
 
-	/* Loop through RX queue */
-	int i, count;
-	rdp_packet_t * packet;
-	count = csp_queue_size(conn->rdp.rx_queue);
-
-	for (i = 0; i < count; i++) {
-		if (csp_queue_dequeue_isr(conn->rdp.rx_queue, &packet, &pdTrue) != CSP_QUEUE_OK) {
-			csp_log_error("RDP %p: Cannot dequeue from rx_queue in queue exists", conn);
-			break;
-		}
-
-		csp_queue_enqueue_isr(conn->rdp.rx_queue, &packet, &pdTrue);
+	/* Loop through RX queue, without removing the packets */
+	csp_packet_t * packets[RDP_QUEUE_BATCH];
+	int first = 0, count;
 
-		rdp_header_t * header = csp_rdp_header_ref((csp_packet_t *) packet);
-		csp_log_protocol("RDP %p: RX Queue exists matching Element, seq %u", conn, header->seq_nr);
+	while ((count = csp_queue_peek_range(conn->rdp.rx_queue, packets, first, RDP_QUEUE_BATCH)) > 0) {
+		for (int i = 0; i < count; i++) {
+			rdp_header_t * header = csp_rdp_header_ref(packets[i]);
+			csp_log_protocol("RDP %p: RX Queue exists matching Element, seq %u", conn, header->seq_nr);
 
-		/* If the matching packet was found, deliver */
-		if (header->seq_nr == seq_nr) {
-			csp_log_protocol("RDP %p: We have a match", conn);
-			return true;
+			/* If the matching packet was found, deliver */
+			if (header->seq_nr == seq_nr) {
+				csp_log_protocol("RDP %p: We have a match", conn);
+				return true;
+			}
 		}
+		first += count;
 	}
 
 	return false;
@@ -387,46 +401,60 @@ static inline int csp_rdp_rx_queue_add(csp_conn_t * conn, csp_packet_t * packet,
 static void csp_rdp_flush_eack(csp_conn_t * conn, csp_packet_t * eack_packet) {
 
 	/* Loop through TX queue */
-	int i, j, count;
-	rdp_packet_t * packet;
-	count = csp_queue_size(conn->rdp.tx_queue);
+	rdp_packet_t * packets[RDP_QUEUE_BATCH];
+	rdp_packet_t * acked[RDP_QUEUE_BATCH];
+	int remaining = csp_queue_size(conn->rdp.tx_queue);
 
-	for (i = 0; i < count; i++) {
-		if (csp_queue_dequeue(conn->rdp.tx_queue, &packet, 0) != CSP_QUEUE_OK) {
+	while (remaining > 0) {
+		int count = csp_queue_dequeue_bulk(conn->rdp.tx_queue, packets, (remaining < RDP_QUEUE_BATCH) ? remaining : RDP_QUEUE_BATCH, 0);
+		if (count == 0) {
 			csp_log_error("RDP %p: Cannot dequeue from tx_queue in flush EACK", conn);
 			break;
 		}
-
-		rdp_header_t * header = csp_rdp_header_ref((csp_packet_t *) packet);
-
-		csp_log_protocol("RDP %p: EACK compare element, time %"PRIu32", seq %u",
-						 conn, packet->timestamp, csp_ntoh16(header->seq_nr));
-
-		/* Look for this element in EACKs */
-		int match = 0;
-
-		for (j = 0; j < (int)((eack_packet->length - sizeof(rdp_header_t)) / sizeof(uint16_t)); j++)
-		{
-			if (csp_ntoh16(eack_packet->data16[j]) == csp_ntoh16(header->seq_nr))
-				match = 1;
-
-			/* Enable this if you want EACK's to trigger retransmission */
-			if (csp_ntoh16(eack_packet->data16[j]) > csp_ntoh16(header->seq_nr)) {
-				uint32_t time_now = csp_get_ms();
-				if (csp_rdp_time_after(time_now, packet->quarantine)) {
-					packet->timestamp = time_now - conn->rdp.packet_timeout - 1;
-					packet->quarantine = time_now +	conn->rdp.packet_timeout / 2;
+		remaining -= count;
+
+		int kept = 0, freed = 0;
+		for (int i = 0; i < count; i++) {
+			rdp_packet_t * packet = packets[i];
+			rdp_header_t * header = csp_rdp_header_ref((csp_packet_t *) packet);
+
+			csp_log_protocol("RDP %p: EACK compare element, time %"PRIu32", seq %u",
+							 conn, packet->timestamp, csp_ntoh16(header->seq_nr));
+
+			/* Look for this element in EACKs */
+			int match = 0;
+
+			for (int j = 0; j < (int)((eack_packet->length - sizeof(rdp_header_t)) / sizeof(uint16_t)); j++)
+			{
+				if (csp_ntoh16(eack_packet->data16[j]) == csp_ntoh16(header->seq_nr))
+					match = 1;
+
+				/* Enable this if you want EACK's to trigger retransmission */
+				if (csp_ntoh16(eack_packet->data16[j]) > csp_ntoh16(header->seq_nr)) {
+					uint32_t time_now = csp_get_ms();
+					if (csp_rdp_time_after(time_now, packet->quarantine)) {
+						packet->timestamp = time_now - conn->rdp.packet_timeout - 1;
+						packet->quarantine = time_now +	conn->rdp.packet_timeout / 2;
+						csp_rdp_timer_arm(conn, time_now);
+					}
 				}
 			}
+
+			if (match == 0) {
+				/* If not found, put back on tx queue */
+				packets[kept++] = packet;
+			} else {
+				/* Found, free */
+				csp_log_protocol("RDP %p: TX Element %u freed", conn, csp_ntoh16(header->seq_nr));
+				acked[freed++] = packet;
+			}
 		}
 
-		if (match == 0) {
-			/* If not found, put back on tx queue */
-			csp_queue_enqueue(conn->rdp.tx_queue, &packet, 0);
-		} else {
-			/* Found, free */
-			csp_log_protocol("RDP %p: TX Element %u freed", conn, csp_ntoh16(header->seq_nr));
-			csp_buffer_free(packet);
+		if (kept > 0) {
+			csp_queue_enqueue_bulk(conn->rdp.tx_queue, packets, kept, 0);
+		}
+		if (freed > 0) {
+			csp_buffer_free_bulk(freed, (void **) acked);
 		}
 	}
 }
@@ -458,22 +486,27 @@ void csp_rdp_flush_all(csp_conn_t * conn) {
 		return;
 	}
 
-	rdp_packet_t * packet;
+	rdp_packet_t * packets[16];
+	int count;
 
 	/* Empty TX queue */
-	while (csp_queue_dequeue_isr(conn->rdp.tx_queue, &packet, &pdTrue) == CSP_QUEUE_OK) {
-		if (packet != NULL) {
-			csp_log_protocol("RDP %p: Flush TX Element, time %"PRIu32", seq %u", conn, packet->timestamp, csp_ntoh16(csp_rdp_header_ref((csp_packet_t *) packet)->seq_nr));
-			csp_buffer_free(packet);
+	while ((count = csp_queue_dequeue_bulk(conn->rdp.tx_queue, packets, sizeof(packets) / sizeof(packets[0]), 0)) > 0) {
+		for (int i = 0; i < count; i++) {
+			if (packets[i] != NULL) {
+				csp_log_protocol("RDP %p: Flush TX Element, time %"PRIu32", seq %u", conn, packets[i]->timestamp, csp_ntoh16(csp_rdp_header_ref((csp_packet_t *) packets[i])->seq_nr));
+			}
 		}
+		csp_buffer_free_bulk(count, (void **) packets);
 	}
 
 	/* Empty RX queue */
-	while (csp_queue_dequeue_isr(conn->rdp.rx_queue, &packet, &pdTrue) == CSP_QUEUE_OK) {
-		if (packet != NULL) {
-			csp_log_protocol("RDP %p: Flush RX Element, time %"PRIu32", seq %u", conn, packet->timestamp, csp_ntoh16(csp_rdp_header_ref((csp_packet_t *) packet)->seq_nr));
-			csp_buffer_free(packet);
+	while ((count = csp_queue_dequeue_bulk(conn->rdp.rx_queue, packets, sizeof(packets) / sizeof(packets[0]), 0)) > 0) {
+		for (int i = 0; i < count; i++) {
+			if (packets[i] != NULL) {
+				csp_log_protocol("RDP %p: Flush RX Element, time %"PRIu32", seq %u", conn, packets[i]->timestamp, csp_ntoh16(csp_rdp_header_ref((csp_packet_t *) packets[i])->seq_nr));
+			}
 		}
+		csp_buffer_free_bulk(count, (void **) packets);
 	}
 }
 
@@ -485,7 +518,7 @@ int csp_rdp_check_ack(csp_conn_t * conn) {
 	int prio;
 
 	for (prio = 0; prio < CSP_RX_QUEUES; prio++) {
-		if (csp_conf.conn_queue_length - csp_queue_size(conn->rx_queue[prio]) <= 2 * (int32_t)conn->rdp.window_size) {
+		if (csp_conf.conn_queue_length - csp_pqueue_size(conn->rx_queue, prio) <= 2 * (int32_t)conn->rdp.window_size) {
 			avail = 0;
 			break;
 		}
@@ -494,6 +527,12 @@ int csp_rdp_check_ack(csp_conn_t * conn) {
 	/* If more space available, only send after ack timeout or immediately if delay_acks is zero */
 	if (avail && csp_rdp_should_ack(conn)) {
 		csp_rdp_send_cmp(conn, NULL, RDP_ACK, conn->rdp.snd_nxt, conn->rdp.rcv_cur);
+		return CSP_ERR_NONE;
+	}
+
+	/* Send the held back ACK later */
+	if (conn->rdp.delayed_acks && (conn->rdp.rcv_cur != conn->rdp.rcv_lsa)) {
+		csp_rdp_timer_arm(conn, avail ? (conn->rdp.ack_timestamp + conn->rdp.ack_timeout) : (csp_get_ms() + RDP_ACK_RECHECK_MS));
 	}
 
 	return CSP_ERR_NONE;
@@ -510,10 +549,21 @@ static inline bool csp_rdp_is_conn_ready_for_tx(csp_conn_t * conn) {
 }
 
 /**
- * This function must be called with regular intervals for the
- * RDP protocol to work as expected. This takes care of closing
- * stale connections and retransmitting traffic. A good place to
- * call this function is from the CSP router task.
+ * Timer callback, runs in the router worker handling the connection.
+ */
+static void csp_rdp_timer_expired(csp_timer_t * timer) {
+
+	csp_conn_t * conn = timer->arg;
+
+	if ((conn->state == CONN_OPEN) && (conn->idin.flags & CSP_FRDP)) {
+		csp_rdp_check_timeouts(conn);
+	}
+}
+
+/**
+ * This function is called from the connection timer, when the next timeout
+ * is due. This takes care of closing stale connections and retransmitting traffic,
+ * and arms the timer for the next timeout.
  */
 void csp_rdp_check_timeouts(csp_conn_t * conn) {
 
@@ -530,6 +580,7 @@ void csp_rdp_check_timeouts(csp_conn_t * conn) {
 			csp_conn_close(conn, CSP_RDP_CLOSED_BY_USERSPACE | CSP_RDP_CLOSED_BY_PROTOCOL | CSP_RDP_CLOSED_BY_TIMEOUT);
 			return;
 		}
+		csp_rdp_timer_arm(conn, conn->timestamp + conn->rdp.conn_timeout);
 	}
 
 	/**
@@ -539,6 +590,8 @@ void csp_rdp_check_timeouts(csp_conn_t * conn) {
 	if (conn->rdp.state == RDP_CLOSE_WAIT) {
 		if (csp_rdp_time_after(time_now, conn->timestamp + conn->rdp.conn_timeout)) {
 			csp_conn_close(conn, CSP_RDP_CLOSED_BY_PROTOCOL | CSP_RDP_CLOSED_BY_TIMEOUT);
+		} else {
+			csp_rdp_timer_arm(conn, conn->timestamp + conn->rdp.conn_timeout);
 		}
 		return;
 	}
@@ -547,45 +600,87 @@ void csp_rdp_check_timeouts(csp_conn_t * conn) {
 	 * MESSAGE TIMEOUT:
 	 * Check each outgoing message for TX timeout
 	 */
-	int count = csp_queue_size(conn->rdp.tx_queue);
-	for (int i = 0; i < count; i++) {
-
-		rdp_packet_t * packet;
-		if ((csp_queue_dequeue_isr(conn->rdp.tx_queue, &packet, &pdTrue) != CSP_QUEUE_OK) || packet == NULL) {
+	rdp_packet_t * packets[RDP_QUEUE_BATCH];
+	rdp_packet_t * acked[RDP_QUEUE_BATCH];
+	int remaining = csp_queue_size(conn->rdp.tx_queue);
+	bool retransmit_pending = false;
+	uint32_t retransmit = 0;
+
+	while (remaining > 0) {
+		int count = csp_queue_dequeue_bulk(conn->rdp.tx_queue, packets, (remaining < RDP_QUEUE_BATCH) ? remaining : RDP_QUEUE_BATCH, 0);
+		if (count == 0) {
 			csp_log_warn("RDP %p: Cannot dequeue from tx_queue in check timeout", conn);
 			break;
 		}
+		remaining -= count;
 
-		/* Get header */
-		rdp_header_t * header = csp_rdp_header_ref((csp_packet_t *) packet);
+		int kept = 0, freed = 0;
+		for (int i = 0; i < count; i++) {
 
-		/* If acked, do not retransmit */
-		if (csp_rdp_seq_before(csp_ntoh16(header->seq_nr), conn->rdp.snd_una)) {
-			csp_log_protocol("RDP %p: TX Element Free, time %"PRIu32", seq %u, una %u", conn, packet->timestamp, csp_ntoh16(header->seq_nr), conn->rdp.snd_una);
-			csp_buffer_free(packet);
-			continue;
-		}
+			rdp_packet_t * packet = packets[i];
+			if (packet == NULL) {
+				continue;
+			}
+
+			/* Get header */
+			rdp_header_t * header = csp_rdp_header_ref((csp_packet_t *) packet);
+
+			/* If acked, do not retransmit */
+			if (csp_rdp_seq_before(csp_ntoh16(header->seq_nr), conn->rdp.snd_una)) {
+				csp_log_protocol("RDP %p: TX Element Free, time %"PRIu32", seq %u, una %u", conn, packet->timestamp, csp_ntoh16(header->seq_nr), conn->rdp.snd_una);
+				acked[freed++] = packet;
+				continue;
+			}
 
-		/* Check timestamp and retransmit if needed */
-		if (csp_rdp_time_after(time_now, packet->timestamp + conn->rdp.packet_timeout)) {
-			csp_log_protocol("RDP %p: TX Element timed out, retransmitting seq %u", conn, csp_ntoh16(header->seq_nr));
+			/* Check timestamp and retransmit if needed */
+			if (csp_rdp_time_after(time_now, packet->timestamp + conn->rdp.packet_timeout)) {
+				csp_log_protocol("RDP %p: TX Element timed out, retransmitting seq %u", conn, csp_ntoh16(header->seq_nr));
+
+				/* The previous transmission may still hold a reference, so get a writable packet for the ACK update */
+				rdp_packet_t * writable = csp_buffer_writable(packet);
+				if (writable != NULL) {
+					if (writable != packet) {
+						csp_buffer_free(packet);
+						packet = writable;
+						header = csp_rdp_header_ref((csp_packet_t *) packet);
+					}
+
+					/* Update to latest outgoing ACK */
+					header->ack_nr = csp_hton16(conn->rdp.rcv_cur);
+
+					/* Share with tx_queue */
+					packet->timestamp = csp_get_ms();
+					csp_packet_t * new_packet = csp_buffer_ref(packet);
+					if (csp_send_direct(conn->idout, new_packet, csp_rtable_find_route(conn->idout.dst), 0) != CSP_ERR_NONE) {
+						csp_log_warn("RDP %p: Retransmission failed", conn);
+						csp_buffer_free(new_packet);
+					}
+				} else {
+					csp_log_warn("RDP %p: Retransmission failed, no buffer", conn);
+				}
 
-			/* Update to latest outgoing ACK */
-			header->ack_nr = csp_hton16(conn->rdp.rcv_cur);
+			}
 
-			/* Send copy to tx_queue */
-			packet->timestamp = csp_get_ms();
-			csp_packet_t * new_packet = csp_buffer_clone(packet);
-			if (csp_send_direct(conn->idout, new_packet, csp_rtable_find_route(conn->idout.dst), 0) != CSP_ERR_NONE) {
-				csp_log_warn("RDP %p: Retransmission failed", conn);
-				csp_buffer_free(new_packet);
+			/* Next retransmit */
+			if (!retransmit_pending || csp_rdp_time_before(packet->timestamp + conn->rdp.packet_timeout, retransmit)) {
+				retransmit = packet->timestamp + conn->rdp.packet_timeout;
+				retransmit_pending = true;
 			}
 
+			/* Requeue the TX element */
+			packets[kept++] = packet;
 		}
 
-		/* Requeue the TX element */
-		csp_queue_enqueue_isr(conn->rdp.tx_queue, &packet, &pdTrue);
+		if (kept > 0) {
+			csp_queue_enqueue_bulk(conn->rdp.tx_queue, packets, kept, 0);
+		}
+		if (freed > 0) {
+			csp_buffer_free_bulk(freed, (void **) acked);
+		}
+	}
 
+	if (retransmit_pending) {
+		csp_rdp_timer_arm(conn, retransmit);
 	}
 
 	if (conn->rdp.state == RDP_OPEN) {
@@ -647,6 +742,7 @@ bool csp_rdp_new_packet(csp_conn_t * conn, csp_packet_t * packet) {
 			csp_log_protocol("RDP %p: Received RST in sequence, no more data incoming, reply with RST", conn);
 			conn->rdp.state = RDP_CLOSE_WAIT;
 			conn->timestamp = csp_get_ms();
+			csp_rdp_timer_arm(conn, conn->timestamp + conn->rdp.conn_timeout);
 			csp_rdp_send_cmp(conn, NULL, RDP_ACK | RDP_RST, conn->rdp.snd_nxt, conn->rdp.rcv_cur);
 
 			if (CSP_USE_RDP_FAST_CLOSE) {
@@ -725,6 +821,9 @@ bool csp_rdp_new_packet(csp_conn_t * conn, csp_packet_t * packet) {
 			conn->rdp.ack_timestamp = csp_get_ms();
 			conn->rdp.state = RDP_OPEN;
 
+			/* Release the acknowledged SYN */
+			csp_rdp_timer_arm(conn, conn->rdp.ack_timestamp);
+
 			csp_log_protocol("RDP %p: NP: Connection OPEN", conn);
 
 			/* Send ACK */
@@ -834,8 +933,11 @@ bool csp_rdp_new_packet(csp_conn_t * conn, csp_packet_t * packet) {
 
 		}
 
-		/* Store current ack'ed sequence number */
-		conn->rdp.snd_una = rx_header->ack_nr + 1;
+		/* Store current ack'ed sequence number, release acknowledged segments and wake Tx task */
+		if (conn->rdp.snd_una != (uint16_t)(rx_header->ack_nr + 1)) {
+			conn->rdp.snd_una = rx_header->ack_nr + 1;
+			csp_rdp_timer_arm(conn, csp_get_ms());
+		}
 
 		/* We have an EACK */
 		if (rx_header->eak) {
@@ -875,7 +977,7 @@ bool csp_rdp_new_packet(csp_conn_t * conn, csp_packet_t * packet) {
 
 		/* Only ACK the message if there is room for a full window in the RX buffer.
 		 * Unacknowledged segments are ACKed by csp_rdp_check_timeouts when the buffer is
-		 * no longer full. */
+		 * no longer full (checked every RDP_ACK_RECHECK_MS). */
 		csp_rdp_check_ack(conn);
 
 		/* Flush RX queue */
@@ -1003,6 +1105,12 @@ int csp_rdp_send(csp_conn_t * conn, csp_packet_t * packet) {
 		return CSP_ERR_RESET;
 	}
 
+	/* The RDP header is a trailer, which must follow the data in the same buffer */
+	if (csp_packet_next(packet)) {
+		csp_log_error("RDP %p: ERROR cannot send chained packet", conn);
+		return CSP_ERR_INVAL;
+	}
+
 	while ((conn->rdp.state == RDP_OPEN) && (csp_rdp_is_conn_ready_for_tx(conn) == false))
 	{
 		csp_log_protocol("RDP %p: Waiting for window update before sending seq %u", conn, conn->rdp.snd_nxt);
@@ -1030,11 +1138,14 @@ int csp_rdp_send(csp_conn_t * conn, csp_packet_t * packet) {
 	tx_header->seq_nr = csp_hton16(conn->rdp.snd_nxt);
 	tx_header->ack = 1;
 
-	/* Send copy to tx_queue */
-	rdp_packet_t * rdp_packet = csp_buffer_clone(packet);
+	/* Set id now, so csp_send_direct() doesn't need to modify the shared packet */
+	packet->id.ext = conn->idout.ext;
+
+	/* Share with tx_queue */
+	rdp_packet_t * rdp_packet = csp_buffer_ref(packet);
 
 	if (rdp_packet == NULL) {
-		csp_log_error("RDP %p: Failed to allocate packet buffer", conn);
+		csp_log_error("RDP %p: Failed to reference packet buffer", conn);
 		return CSP_ERR_NOMEM;
 	}
 
@@ -1047,6 +1158,8 @@ int csp_rdp_send(csp_conn_t * conn, csp_packet_t * packet) {
 		return CSP_ERR_NOBUFS;
 	}
 
+	csp_rdp_timer_arm(conn, rdp_packet->timestamp + conn->rdp.packet_timeout);
+
 	csp_log_protocol("RDP %p: Sending  in S %u: syn %u, ack %u, eack %u, "
 				"rst %u, seq_nr %5u, ack_nr %5u, packet_len %u (%u)",
 				conn, conn->rdp.state, tx_header->syn, tx_header->ack, tx_header->eak,
@@ -1065,6 +1178,7 @@ int csp_rdp_init(csp_conn_t * conn) {
 	conn->rdp.state = RDP_CLOSED;
 	conn->rdp.conn_timeout = csp_rdp_conn_timeout;
 	conn->rdp.packet_timeout = csp_rdp_packet_timeout;
+	csp_timer_setup(&conn->rdp.timer, csp_rdp_timer_expired, conn);
 
 	/* Create a binary semaphore to wait on for tasks */
 	if (csp_bin_sem_create(&conn->rdp.tx_wait) != CSP_SEMAPHORE_OK) {
@@ -1120,6 +1234,7 @@ static int csp_rdp_close_internal(csp_conn_t * conn, uint8_t closed_by, bool sen
 	if (conn->rdp.state != RDP_CLOSE_WAIT) {
 		conn->rdp.state = RDP_CLOSE_WAIT;
 		conn->timestamp = csp_get_ms();
+		csp_rdp_timer_arm(conn, conn->timestamp + conn->rdp.conn_timeout);
 
 		if (send_rst) {
 			csp_rdp_send_cmp(conn, NULL, RDP_ACK | RDP_RST, conn->rdp.snd_nxt, conn->rdp.rcv_cur);
@@ -1140,6 +1255,7 @@ static int csp_rdp_close_internal(csp_conn_t * conn, uint8_t closed_by, bool sen
 	csp_log_protocol("RDP %p: csp_rdp_close(0x%x) -> CLOSED", conn, closed_by);
 	conn->rdp.state = RDP_CLOSED;
 	conn->rdp.closed_by = 0;
+	csp_timer_cancel(&conn->rdp.timer);
 	return CSP_ERR_NONE;
 }
 